@@ -0,0 +1,2543 @@
+#ifndef AVLTREE_H
+#define AVLTREE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include "BinarySearch.h"
+#include "Checkpoint.h"
+#include "MergePath.h"
+#include "Profiler.h"
+#include "SearchKernels.h"
+#include "TraceRecorder.h"
+
+// ----------------------------------------------------
+// AVL Node Definition
+// ----------------------------------------------------
+template <typename T>
+class AVLNode {
+public:
+    T key;
+    AVLNode* left;
+    AVLNode* right;
+    int height;
+    // Searches that passed through this node (only while visit
+    // counting is enabled). Relaxed load+store rather than fetch_add:
+    // an occasional lost increment is fine for a heatmap and keeps
+    // the search path free of locked instructions.
+    std::atomic<unsigned> visits;
+    // Searches that found this node's key. Unlike visits, this belongs
+    // to the key rather than to the node's place in the tree.
+    std::atomic<unsigned> hits;
+
+    AVLNode(T k)
+        : key(k), left(nullptr), right(nullptr), height(1), visits(0), hits(0)
+    {}
+
+    void countVisit() {
+        visits.store(visits.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+    }
+
+    void countHit() {
+        hits.store(hits.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_relaxed);
+    }
+};
+
+// ----------------------------------------------------
+// Node arena
+//   Every rebuild allocates exactly one node per key, so the nodes of
+//   one tree are carved out of a single block. Dropping the arena
+//   releases the whole tree at once: one deallocation, plus a
+//   destructor pass only when T needs one.
+// ----------------------------------------------------
+template <typename T>
+class NodeArena {
+public:
+    explicit NodeArena(size_t capacity)
+        : nodes(static_cast<AVLNode<T>*>(::operator new(capacity * sizeof(AVLNode<T>)))),
+          capacity(capacity),
+          used(0)
+    {}
+
+    ~NodeArena() {
+        if (!std::is_trivially_destructible<AVLNode<T>>::value) {
+            for (size_t i = 0; i < used; i++) {
+                nodes[i].~AVLNode<T>();
+            }
+        }
+        ::operator delete(nodes);
+    }
+
+    NodeArena(const NodeArena&) = delete;
+    NodeArena& operator=(const NodeArena&) = delete;
+
+    AVLNode<T>* make(const T& key) {
+        return new (nodes + used++) AVLNode<T>(key);
+    }
+
+    // Construct the node in slot "i" (for builders that fill the
+    // slots out of order; every slot below capacity must end up used)
+    AVLNode<T>* makeAt(size_t i, const T& key) {
+        used++;
+        return constructAt(i, key);
+    }
+
+    // Same without counting the node, for several builders filling one
+    // arena at once; the caller counts them all with markUsed()
+    AVLNode<T>* constructAt(size_t i, const T& key) {
+        return new (nodes + i) AVLNode<T>(key);
+    }
+
+    void markUsed(size_t count) {
+        used += count;
+    }
+
+    // Address of slot "i", constructed or not
+    AVLNode<T>* slot(size_t i) {
+        return nodes + i;
+    }
+
+    size_t size() const {
+        return used;
+    }
+
+    // Successor links: an optional table, indexed by slot, of each
+    // node's in-order successor (nullptr for the last). Builders fill
+    // it while writing the nodes; it survives clear() for reuse.
+    void enableSuccessors() {
+        if (!successors) {
+            successors.reset(new AVLNode<T>*[capacity]);
+        }
+    }
+
+    bool hasSuccessors() const {
+        return successors != nullptr;
+    }
+
+    void linkSuccessor(long slot, long nextSlot) {
+        successors[slot] = nextSlot < 0 ? nullptr : nodes + nextSlot;
+    }
+
+    AVLNode<T>* successor(const AVLNode<T>* node) const {
+        return successors[node - nodes];
+    }
+
+    // Fetch the successor link of "node" ahead of successor()
+    void prefetchSuccessor(const AVLNode<T>* node) const {
+        __builtin_prefetch(&successors[node - nodes]);
+    }
+
+    bool canHold(size_t count) const {
+        return count <= capacity;
+    }
+
+    // Destroy every node but keep the block, for reuse by the next build
+    void clear() {
+        if (!std::is_trivially_destructible<AVLNode<T>>::value) {
+            for (size_t i = 0; i < used; i++) {
+                nodes[i].~AVLNode<T>();
+            }
+        }
+        used = 0;
+    }
+
+private:
+    AVLNode<T>* nodes;
+    size_t capacity;
+    size_t used;
+    std::unique_ptr<AVLNode<T>*[]> successors;
+};
+
+// ----------------------------------------------------
+// Iterative tree builder
+//   Builds the upper-middle tree over keys[0..n-1] into an arena of
+//   capacity n. An explicit stack of index ranges (at most one per
+//   level) replaces the recursion, and every node is written exactly
+//   once with its key, both child pointers and its height, which
+//   depends only on the size of its range: a range of m keys gives a
+//   subtree of height bit_width(m).
+//
+//   "order" picks the slot each node gets in the arena:
+//     InOrder      - slot = rank, like the sorted vector
+//     BreadthFirst - level by level, so the top levels share a few
+//                    cache lines and each level is written as one
+//                    sequential stream
+//     VanEmdeBoas  - recursive blocks of about half the height, so a
+//                    search path touches few blocks at any cache size
+// ----------------------------------------------------
+enum class NodeOrder { InOrder, BreadthFirst, VanEmdeBoas };
+
+namespace avl_build {
+
+struct Range {
+    long lo;
+    long hi;
+};
+
+// Rank of the root of keys[lo..hi]
+inline long middle(long lo, long hi) {
+    return (lo + hi + 1) / 2; // "upper" middle
+}
+
+// Height of the upper-middle tree over m keys
+inline int heightOf(long m) {
+    return m <= 0 ? 0 : 64 - __builtin_clzll((unsigned long long)m);
+}
+
+// Depth (root = 0) of the node of rank r, 0 <= r < n, found by
+// replaying the search on ranks alone
+inline int depthOfRank(long n, long r) {
+    long lo = 0, hi = n - 1;
+    int depth = 0;
+    for (long mid = middle(lo, hi); mid != r; mid = middle(lo, hi)) {
+        if (r < mid) {
+            hi = mid - 1;
+        } else {
+            lo = mid + 1;
+        }
+        depth++;
+    }
+    return depth;
+}
+
+// Rank of the ancestor of rank r at depth "level", or -1 when r is
+// not that deep
+inline long ancestorRank(long n, long r, int level) {
+    long lo = 0, hi = n - 1;
+    for (int depth = 0;; depth++) {
+        long mid = middle(lo, hi);
+        if (depth == level) {
+            return mid;
+        }
+        if (mid == r) {
+            return -1;
+        } else if (r < mid) {
+            hi = mid - 1;
+        } else {
+            lo = mid + 1;
+        }
+    }
+}
+
+// Rank of the lowest common ancestor of ranks a and b: the first node
+// whose range the two leave on different sides (or that is one of them)
+inline long lcaRank(long n, long a, long b) {
+    long lo = 0, hi = n - 1;
+    for (;;) {
+        long mid = middle(lo, hi);
+        if (a < mid && b < mid) {
+            hi = mid - 1;
+        } else if (a > mid && b > mid) {
+            lo = mid + 1;
+        } else {
+            return mid;
+        }
+    }
+}
+
+// levelStart[d] = number of nodes above depth d. The ranges of one
+// level hold either s or s + 1 keys, and a range of m keys splits into
+// m / 2 and (m - 1) / 2, so each level follows from the one above in
+// O(1) without visiting its nodes.
+inline void levelStarts(long n, std::vector<long>& levelStart) {
+    levelStart.clear();
+    long small = n, smallCount = 1, largeCount = 0;
+    long total = 0;
+    while (smallCount + largeCount > 0) {
+        levelStart.push_back(total);
+        total += smallCount + largeCount;
+
+        long sizes[4]  = {small / 2, (small - 1) / 2, (small + 1) / 2, small / 2};
+        long counts[4] = {smallCount, smallCount, largeCount, largeCount};
+        long nextSmall = -1;
+        for (int i = 0; i < 4; i++) {
+            if (counts[i] > 0 && sizes[i] > 0 && (nextSmall < 0 || sizes[i] < nextSmall)) {
+                nextSmall = sizes[i];
+            }
+        }
+        long nextSmallCount = 0, nextLargeCount = 0;
+        for (int i = 0; i < 4; i++) {
+            if (counts[i] > 0 && sizes[i] > 0) {
+                (sizes[i] == nextSmall ? nextSmallCount : nextLargeCount) += counts[i];
+            }
+        }
+        small = nextSmall;
+        smallCount = nextSmallCount;
+        largeCount = nextLargeCount;
+    }
+}
+
+// Ranges of the subtrees "depth" levels below the tree over "r",
+// left to right (empty ranges are dropped)
+inline void rangesBelow(Range r, int depth, std::vector<Range>& out, std::vector<Range>& next) {
+    out.assign(1, r);
+    for (int d = 0; d < depth; d++) {
+        next.clear();
+        for (const Range& c : out) {
+            long mid = middle(c.lo, c.hi);
+            if (c.lo <= mid - 1) {
+                next.push_back({c.lo, mid - 1});
+            }
+            if (mid + 1 <= c.hi) {
+                next.push_back({mid + 1, c.hi});
+            }
+        }
+        out.swap(next);
+    }
+}
+
+// slotOfRank[r] = van Emde Boas position of the node of rank r.
+// A task lays out "levels" levels of the tree over a range: the top
+// half of them first, then each subtree hanging below, left to right.
+inline void vanEmdeBoasSlots(long n, std::vector<long>& slotOfRank) {
+    struct Task {
+        Range range;
+        int levels;
+    };
+    slotOfRank.assign(n, 0);
+    long next = 0;
+    std::vector<Task> stack{{{0, n - 1}, heightOf(n)}};
+    std::vector<Range> below;
+    std::vector<Range> scratch;
+    while (!stack.empty()) {
+        Task task = stack.back();
+        stack.pop_back();
+        if (task.levels == 1) {
+            slotOfRank[middle(task.range.lo, task.range.hi)] = next++;
+            continue;
+        }
+        int top = task.levels / 2;
+        rangesBelow(task.range, top, below, scratch);
+        // Pushed in reverse so they pop top first, then left to right
+        for (auto it = below.rbegin(); it != below.rend(); ++it) {
+            stack.push_back({*it, task.levels - top});
+        }
+        stack.push_back({task.range, top});
+    }
+}
+
+} // namespace avl_build
+
+// Resumable form of the builder: step() writes a bounded number of
+// nodes, so a build can be spread over many calls. Nodes are written
+// in preorder; each node's slot is chosen before the node is written
+// (so its parent can point at it), and the nodes of one depth get
+// their slots in left-to-right order.
+// If the arena keeps successor links, each range also carries the
+// slots of the nodes just before and after it in order. A node
+// without a right child links to the node after its range, and a node
+// without a left child is the successor of the node before its range;
+// together that links every adjacent pair of keys exactly once.
+template <typename T>
+class TreeBuilder {
+public:
+    // "arena" must be empty with capacity for n nodes, and both it and
+    // keys[0..n-1] must stay in place until the build is done
+    TreeBuilder(const T* keys, long n, NodeArena<T>& arena, NodeOrder order)
+        : keys(keys), arena(arena), order(order), rankSlots(nullptr), top(0),
+          rootNode(nullptr), counted(true)
+    {
+        if (n <= 0) {
+            return;
+        }
+        if (order == NodeOrder::VanEmdeBoas) {
+            avl_build::vanEmdeBoasSlots(n, slotOfRank);
+            rankSlots = slotOfRank.data();
+        } else if (order == NodeOrder::BreadthFirst) {
+            avl_build::levelStarts(n, slotOfRank);
+        }
+        stack[top++] = {0, n - 1, slotFor(avl_build::middle(0, n - 1), 0), 0, -1, -1};
+        rootNode = arena.slot(stack[0].slot);
+    }
+
+    // Builder for one subtree of a larger tree: the range "r" at
+    // "depth", rooted in slot "rootSlot". Breadth-first: levelSlots[d]
+    // is the slot of the subtree's leftmost node at depth d. van Emde
+    // Boas: vebSlots is the whole tree's slot of every rank. predSlot
+    // and succSlot are the nodes just outside "r" (-1 for none). Its
+    // nodes are not counted by the arena (see NodeArena::markUsed).
+    TreeBuilder(const T* keys, avl_build::Range r, int depth, long rootSlot,
+                NodeArena<T>& arena, NodeOrder order, std::vector<long> levelSlots,
+                const long* vebSlots, long predSlot, long succSlot)
+        : keys(keys), arena(arena), order(order), slotOfRank(std::move(levelSlots)),
+          rankSlots(vebSlots), top(0), rootNode(arena.slot(rootSlot)), counted(false)
+    {
+        stack[top++] = {r.lo, r.hi, rootSlot, depth, predSlot, succSlot};
+    }
+
+    TreeBuilder(const TreeBuilder&) = delete;
+    TreeBuilder& operator=(const TreeBuilder&) = delete;
+
+    // Write up to "budget" more nodes; true once the tree is complete
+    bool step(size_t budget) {
+        using avl_build::middle;
+        bool linked = arena.hasSuccessors();
+        for (; budget > 0 && top > 0; budget--) {
+            Pending p = stack[--top];
+            long mid = middle(p.lo, p.hi);
+            AVLNode<T>* node = counted ? arena.makeAt(p.slot, keys[mid])
+                                       : arena.constructAt(p.slot, keys[mid]);
+            node->height = avl_build::heightOf(p.hi - p.lo + 1);
+            if (linked) {
+                if (mid == p.hi) {
+                    arena.linkSuccessor(p.slot, p.succ);
+                }
+                if (mid == p.lo && p.pred >= 0) {
+                    arena.linkSuccessor(p.pred, p.slot);
+                }
+            }
+
+            long leftSlot = -1;
+            if (p.lo <= mid - 1) {
+                leftSlot = slotFor(middle(p.lo, mid - 1), p.depth + 1);
+                node->left = arena.slot(leftSlot);
+            }
+            if (mid + 1 <= p.hi) {
+                long rightSlot = slotFor(middle(mid + 1, p.hi), p.depth + 1);
+                node->right = arena.slot(rightSlot);
+                stack[top++] = {mid + 1, p.hi, rightSlot, p.depth + 1, p.slot, p.succ};
+            }
+            if (leftSlot >= 0) {
+                stack[top++] = {p.lo, mid - 1, leftSlot, p.depth + 1, p.pred, p.slot};
+            }
+        }
+        return done();
+    }
+
+    bool done() const {
+        return top == 0;
+    }
+
+    // Root of the finished tree (nullptr for no keys)
+    AVLNode<T>* root() const {
+        return rootNode;
+    }
+
+private:
+    struct Pending {
+        long lo;
+        long hi;
+        long slot;
+        int depth;
+        long pred; // slots of the nodes just outside lo..hi, or -1
+        long succ;
+    };
+
+    const T* keys;
+    NodeArena<T>& arena;
+    NodeOrder order;
+    // van Emde Boas: slot of each rank. Breadth-first: next free slot
+    // of each depth (preorder reaches the nodes of a level left to
+    // right, so that is the node's BFS position).
+    std::vector<long> slotOfRank;
+    const long* rankSlots; // van Emde Boas table (slotOfRank's or shared)
+    // The left child is popped before its sibling is pushed, so the
+    // stack holds at most one range per level plus one
+    Pending stack[66];
+    int top;
+    AVLNode<T>* rootNode;
+    bool counted;
+
+    long slotFor(long rank, int depth) {
+        switch (order) {
+        case NodeOrder::InOrder:     return rank;
+        case NodeOrder::VanEmdeBoas: return rankSlots[rank];
+        default:                     return slotOfRank[depth]++;
+        }
+    }
+};
+
+// Returns the root (nullptr for no keys); "arena" must be empty with
+// capacity for n nodes
+template <typename T>
+AVLNode<T>* buildUpperMiddleTree(const T* keys, long n, NodeArena<T>& arena,
+                                 NodeOrder order)
+{
+    TreeBuilder<T> builder(keys, n, arena, order);
+    builder.step((size_t)std::max(n, 0L));
+    return builder.root();
+}
+
+// Same with the subtrees below the top few levels built on up to
+// "threads" threads (0 = one per core). A node's slot follows from its
+// rank and depth alone, so the builders never share a slot. Breadth-
+// first builders start each level where the subtrees to their left
+// end, which the subtree sizes give without visiting any node.
+template <typename T>
+AVLNode<T>* buildUpperMiddleTreeParallel(const T* keys, long n, NodeArena<T>& arena,
+                                         NodeOrder order, unsigned threads)
+{
+    using avl_build::Range;
+    using avl_build::middle;
+    threads = mergePathThreads(threads, (size_t)std::max(n, 0L));
+    int height = avl_build::heightOf(n);
+    if (threads <= 1 || height < 8) {
+        return buildUpperMiddleTree(keys, n, arena, order);
+    }
+
+    // Cut where there are about four subtrees per thread
+    int cut = 0;
+    while ((1L << cut) < 4L * threads && cut + 2 < height) {
+        cut++;
+    }
+
+    std::vector<long> veb, levelStart;
+    if (order == NodeOrder::VanEmdeBoas) {
+        avl_build::vanEmdeBoasSlots(n, veb);
+    } else if (order == NodeOrder::BreadthFirst) {
+        avl_build::levelStarts(n, levelStart);
+    }
+    // Slot of the node of "rank", the index-th node of its depth
+    auto slotAt = [&](long rank, int depth, long index) -> long {
+        switch (order) {
+        case NodeOrder::InOrder:     return rank;
+        case NodeOrder::VanEmdeBoas: return veb[rank];
+        default:                     return levelStart[depth] + index;
+        }
+    };
+
+    // Write the levels above the cut; "level" ends with the subtrees.
+    // bounds[i] holds the slots just outside level[i] (see TreeBuilder).
+    struct Bounds {
+        long pred;
+        long succ;
+    };
+    bool linked = arena.hasSuccessors();
+    long rootSlot = slotAt(middle(0, n - 1), 0, 0);
+    std::vector<Range> level{{0, n - 1}}, next;
+    std::vector<long> slots{rootSlot}, nextSlots;
+    std::vector<Bounds> bounds{{-1, -1}}, nextBounds;
+    for (int d = 0; d < cut; d++) {
+        next.clear();
+        nextSlots.clear();
+        nextBounds.clear();
+        for (size_t i = 0; i < level.size(); i++) {
+            Range c = level[i];
+            Bounds b = bounds[i];
+            long mid = middle(c.lo, c.hi);
+            AVLNode<T>* node = arena.constructAt(slots[i], keys[mid]);
+            node->height = avl_build::heightOf(c.hi - c.lo + 1);
+            if (linked) {
+                if (mid == c.hi) {
+                    arena.linkSuccessor(slots[i], b.succ);
+                }
+                if (mid == c.lo && b.pred >= 0) {
+                    arena.linkSuccessor(b.pred, slots[i]);
+                }
+            }
+            if (c.lo <= mid - 1) {
+                next.push_back({c.lo, mid - 1});
+                nextSlots.push_back(slotAt(middle(c.lo, mid - 1), d + 1, (long)next.size() - 1));
+                nextBounds.push_back({b.pred, slots[i]});
+                node->left = arena.slot(nextSlots.back());
+            }
+            if (mid + 1 <= c.hi) {
+                next.push_back({mid + 1, c.hi});
+                nextSlots.push_back(slotAt(middle(mid + 1, c.hi), d + 1, (long)next.size() - 1));
+                nextBounds.push_back({slots[i], b.succ});
+                node->right = arena.slot(nextSlots.back());
+            }
+        }
+        level.swap(next);
+        slots.swap(nextSlots);
+        bounds.swap(nextBounds);
+    }
+
+    // Breadth-first: where each subtree's levels start
+    std::vector<std::vector<long>> levelSlots(level.size());
+    if (order == NodeOrder::BreadthFirst) {
+        std::vector<long> cursor = levelStart, sub;
+        for (size_t j = 0; j < level.size(); j++) {
+            levelSlots[j] = cursor;
+            long size = level[j].hi - level[j].lo + 1;
+            avl_build::levelStarts(size, sub);
+            for (size_t l = 0; l < sub.size(); l++) {
+                cursor[cut + l] += (l + 1 < sub.size() ? sub[l + 1] : size) - sub[l];
+            }
+        }
+    }
+
+    runOnThreads(threads, [&](unsigned t) {
+        size_t first = level.size() * t / threads;
+        size_t last = level.size() * (t + 1) / threads;
+        for (size_t j = first; j < last; j++) {
+            TreeBuilder<T> builder(keys, level[j], cut, slots[j], arena, order,
+                                   std::move(levelSlots[j]), veb.data(),
+                                   bounds[j].pred, bounds[j].succ);
+            builder.step((size_t)(level[j].hi - level[j].lo + 1));
+        }
+    });
+    arena.markUsed((size_t)n);
+    return arena.slot(rootSlot);
+}
+
+// ----------------------------------------------------
+// Memory footprint and rebuild amplification of one tree
+// ----------------------------------------------------
+struct AVLMemoryStats {
+    size_t elementBytes;         // sortedElements.size() * sizeof(T)
+    size_t elementCapacityBytes; // sortedElements.capacity() * sizeof(T)
+    size_t liveNodes;            // nodes reachable from the root
+    size_t liveNodeBytes;
+    size_t leakedNodes;          // always 0: nodes are freed with their arena
+    size_t pendingReclaimNodes;  // dropped by this tree, kept alive by clones (which
+                                 // count them as their own live nodes)
+    size_t sharedBytes;          // part of the element capacity and live node bytes
+                                 // that copies hold too; count it once across trees
+    size_t deltaEntries;         // writes not yet in the tree (incremental rebuilds)
+    size_t deadKeys;             // removed keys kept as tombstones until compaction
+    size_t searchIndexBytes;     // extra structure of the autotuned search kernel
+    size_t weightedNodes;        // nodes of the frequency-weighted tree, if built
+
+    // Cumulative since the tree was created
+    unsigned long long nodesAllocated;   // by buildBalancedTree
+    unsigned long long elementsShifted;  // moved by vector insert/erase or merges
+};
+
+// ----------------------------------------------------
+// Policies of AVLTree
+//   Chosen at compile time, so combinations cost no virtual calls and
+//   the search loop of each one is inlined. Incremental<N> and
+//   Eytzinger also fix the write and search path at compile time;
+//   Eager and Lazy trees with pointer nodes keep one runtime check,
+//   because setIncrementalRebuild can switch them over.
+//
+//   Storage - where the sorted keys live
+//     SortedVector   one contiguous std::vector (shared copy-on-write)
+//   Layout - what the search walks
+//     PointerNodes   AVLNode objects in a NodeArena (getRoot and
+//                    getSearchPath need this layout)
+//     Eytzinger      keys only, in an array indexed like a heap (the
+//                    children of slot i are 2i and 2i + 1), so a search
+//                    needs no pointers. The upper-middle tree is not
+//                    complete, so the array has gaps: up to 2n slots.
+//   Rebuild - when a write reaches the search structure
+//     Eager          rebuild on every write
+//     Lazy           writes only update the keys; the next search (or
+//                    getRoot / getSearchPath) rebuilds once
+//     Incremental<N> spread each rebuild over the following calls, N
+//                    nodes per call (see setIncrementalRebuild)
+// ----------------------------------------------------
+namespace avl_policy {
+
+struct SortedVector {
+    template <typename T>
+    using Container = std::vector<T>;
+};
+
+struct PointerNodes {};
+struct Eytzinger {};
+
+struct Eager {
+    static const size_t nodesPerOp = 0;
+};
+
+struct Lazy {
+    static const size_t nodesPerOp = 0;
+};
+
+template <size_t N = 256>
+struct Incremental {
+    static_assert(N > 0, "Incremental needs a positive budget");
+    static const size_t nodesPerOp = N;
+};
+
+} // namespace avl_policy
+
+// ----------------------------------------------------
+// "Special AVL" Tree
+//   - Maintains a sorted vector of keys
+//   - Rebuilds a perfectly balanced tree on each insert
+//   - Copies (and clone()) share the keys and nodes copy-on-write:
+//     the first mutation copies the keys, and every rebuild makes a
+//     fresh arena anyway, so nodes are never modified once shared.
+//     With visit counting on, a search writes to its nodes, so it
+//     counts as a mutation and first moves the tree to its own arena.
+//   - Optionally rebuilds incrementally (see setIncrementalRebuild):
+//     writes go to a small sorted delta that is consulted before the
+//     tree, while the next tree is merged and built a fixed number of
+//     nodes per call, then swapped in
+// ----------------------------------------------------
+template <typename T,
+          typename Storage = avl_policy::SortedVector,
+          typename Layout = avl_policy::PointerNodes,
+          typename Rebuild = avl_policy::Eager,
+          typename Compare = std::less<T>>
+class AVLTree {
+public:
+    typedef typename Storage::template Container<T> Keys;
+
+private:
+    static const bool kEytzinger = std::is_same<Layout, avl_policy::Eytzinger>::value;
+    static const bool kLazy = std::is_same<Rebuild, avl_policy::Lazy>::value;
+    // Incremental<N> trees always rebuild incrementally; Eager and Lazy
+    // trees can switch to it at run time (setIncrementalRebuild), except
+    // with the Eytzinger layout
+    static const bool kIncremental = Rebuild::nodesPerOp > 0;
+    static_assert(!kEytzinger || Rebuild::nodesPerOp == 0,
+                  "incremental rebuilds build pointer nodes");
+
+    // Keys in heap order for the Eytzinger layout; used[i] is 0 for
+    // the gaps. Shared copy-on-write like the nodes.
+    struct EytzingerImage {
+        std::vector<T> keys;
+        std::vector<unsigned char> used;
+    };
+
+    AVLNode<T>* root;
+    std::shared_ptr<Keys> sortedElements;           // Always keeps keys in sorted order
+    std::shared_ptr<NodeArena<T>> arena;            // Owns every node of the tree
+    std::shared_ptr<const EytzingerImage> eytzinger; // Eytzinger layout only
+    TraceRecorder* recorder;                        // Optional operation log (not owned)
+    Checkpointer<T, Compare>* checkpointer;         // Optional dirty-chunk tracker (not owned)
+    Compare comp;
+    bool stale;                                     // Lazy: keys changed since the build
+    unsigned long long keysVersion;                 // Bumped when sortedElements changes (see Cursor)
+
+    // Arenas dropped by rebuilds while a clone still used them
+    std::vector<std::weak_ptr<NodeArena<T>>> sharedDropped;
+
+    // Write amplification counters (see memoryStats)
+    size_t liveNodes;
+    unsigned long long nodesAllocated;
+    unsigned long long elementsShifted;
+    ProfileStat rebuildTime;
+    bool countVisits;
+    NodeOrder nodeOrder;    // Arena layout used by rebuilds
+    unsigned parallelism;   // Threads of batch merges and rebuilds, 0 = one per core
+    bool successorLinks;    // Builds fill the arena's successor links
+    std::vector<AVLNode<T>*> appendPool;    // Scratch of appendInPlace
+    std::vector<unsigned> appendHits;       // Scratch of appendInPlace
+
+    // Tombstones (see setTombstones): bit r set = sortedElements[r] was
+    // removed but still routes searches in the tree. deadSlots marks
+    // the same keys by arena slot, so a tree search can test its node.
+    std::vector<uint64_t> dead;
+    std::vector<uint64_t> deadSlots;
+    size_t deadCount;
+    double tombstoneThreshold;  // Dead fraction that triggers compaction, 0 = off
+
+    // Incremental rebuilds. A delta entry holds the current state of
+    // one key (true = present), overriding the tree; sorted by key.
+    typedef std::vector<std::pair<T, bool>> Delta;
+    struct PendingBuild {
+        std::shared_ptr<Keys> keys;              // sortedElements merged with frozenDelta
+        size_t baseIndex = 0;                    // merge progress
+        size_t deltaIndex = 0;
+        std::shared_ptr<NodeArena<T>> arena;
+        std::unique_ptr<TreeBuilder<T>> builder; // set once the merge is done
+    };
+    size_t rebuildBudget;   // Nodes per operation, 0 = rebuild on every write
+    Delta liveDelta;        // Writes since the pending build started
+    Delta frozenDelta;      // Writes the pending build merges in
+    long deltaNet;          // size() - sortedElements->size()
+    std::unique_ptr<PendingBuild> pending;
+    // The buffers of the tree before the last swap, reused by the next
+    // build so that neither the swap nor the build frees or maps memory
+    std::shared_ptr<NodeArena<T>> spareArena;
+    std::shared_ptr<Keys> spareKeys;
+
+    // Search kernel picked by autotune(); anything but Pointer answers
+    // search() from "index", rebuilt with the tree
+    SearchKernel searchKernel;
+    std::shared_ptr<const SearchIndex<T, Compare>> index;
+    AutotuneReport tuneReport;
+
+    // Optional tree shaped by access frequencies (see buildWeighted),
+    // over the same sortedElements; never modified once built, so
+    // copies share it like the keys
+    struct WeightedTree {
+        std::shared_ptr<NodeArena<T>> arena;
+        AVLNode<T>* root;
+    };
+    std::shared_ptr<const WeightedTree> weighted;
+
+    // Compute the node's height
+    int height(AVLNode<T>* node) {
+        return (node == nullptr) ? 0 : node->height;
+    }
+
+    // Key equivalence under Compare
+    bool same(const T& a, const T& b) const {
+        return !comp(a, b) && !comp(b, a);
+    }
+
+    // Position of the first key not less than "key"
+    size_t lowerBound(const T& key) const {
+        return std::lower_bound(sortedElements->begin(), sortedElements->end(), key, comp)
+               - sortedElements->begin();
+    }
+
+    // Rank of "key" in sortedElements, or -1 if absent (or dead)
+    long rankOf(const T& key) const {
+        size_t pos = lowerBound(key);
+        bool live = pos < sortedElements->size() && same((*sortedElements)[pos], key) && !isDead(pos);
+        return live ? (long)pos : -1;
+    }
+
+    static bool testBit(const std::vector<uint64_t>& bits, size_t i) {
+        return i / 64 < bits.size() && (bits[i / 64] >> (i % 64)) & 1;
+    }
+
+    static void setBit(std::vector<uint64_t>& bits, size_t i, bool value) {
+        if (bits.size() <= i / 64) {
+            bits.resize(i / 64 + 1, 0);
+        }
+        if (value) {
+            bits[i / 64] |= uint64_t(1) << (i % 64);
+        } else {
+            bits[i / 64] &= ~(uint64_t(1) << (i % 64));
+        }
+    }
+
+    bool isDead(size_t rank) const {
+        return deadCount > 0 && testBit(dead, rank);
+    }
+
+    // Mark the slots of the dead keys in a freshly built tree
+    void markDeadSlots(AVLNode<T>* tree) {
+        deadSlots.clear();
+        if (deadCount == 0 || !tree) {
+            return;
+        }
+        std::vector<AVLNode<T>*> nodes;
+        collectInorder(tree, nodes);
+        for (size_t r = 0; r < nodes.size(); r++) {
+            if (isDead(r)) {
+                setBit(deadSlots, (size_t)(nodes[r] - arena->slot(0)), true);
+            }
+        }
+    }
+
+    // Drop the dead keys from sortedElements in one pass. The tree no
+    // longer matches the keys: the caller rebuilds it.
+    void purgeDead() {
+        if (deadCount == 0) {
+            return;
+        }
+        detach();
+        Keys& keys = *sortedElements;
+        size_t out = 0;
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (isDead(i)) {
+                continue;
+            }
+            if (out != i) {
+                keys[out] = keys[i];
+                elementsShifted++;
+            }
+            out++;
+        }
+        keys.resize(out);
+        dead.clear();
+        deadSlots.clear();
+        deadCount = 0;
+        keysChanged();
+    }
+
+    // Remove the dead keys and rebuild (Lazy: put the rebuild off)
+    void compactTombstones() {
+        purgeDead();
+        if (kLazy) {
+            stale = true;
+        } else {
+            root = rebuildAll();
+        }
+    }
+
+    // Tombstone mode remove: mark the key dead and leave it in the tree
+    // as a separator; compact once too many keys are dead
+    void markDead(const T& key) {
+        long r = rankOf(key);
+        if (r < 0) {
+            return;
+        }
+        refresh();
+        if (countVisits) {
+            detachArena();
+        }
+        AVLNode<T>* node = findNode(root, key);
+        setBit(dead, (size_t)r, true);
+        setBit(deadSlots, (size_t)(node - arena->slot(0)), true);
+        deadCount++;
+        if ((double)deadCount > tombstoneThreshold * (double)sortedElements->size()) {
+            compactTombstones();
+        }
+    }
+
+    // Tombstone mode insert: a dead key comes back by clearing its bit;
+    // any other insert shifts ranks, so the dead keys go first
+    void insertWithTombstones(const T& key) {
+        size_t pos = lowerBound(key);
+        if (pos < sortedElements->size() && same((*sortedElements)[pos], key)) {
+            if (isDead(pos)) {
+                refresh();
+                if (countVisits) {
+                    detachArena();
+                }
+                setBit(dead, pos, false);
+                setBit(deadSlots, (size_t)(findNode(root, key) - arena->slot(0)), false);
+                deadCount--;
+            }
+            return;
+        }
+        purgeDead();
+        insertSorted(key);
+        if (kLazy) {
+            stale = true;
+        } else {
+            root = rebuildAll();
+        }
+    }
+
+    // Build a perfectly balanced BST from all of sortedElements
+    // For an even count of elements, pick the "upper" middle:
+    //    mid = (start + end + 1) / 2
+    AVLNode<T>* buildBalancedTree() {
+        nodesAllocated += sortedElements->size();
+        return buildUpperMiddleTreeParallel(sortedElements->data(),
+                                            (long)sortedElements->size(), *arena, nodeOrder,
+                                            parallelism);
+    }
+
+    // Lay the keys out in heap order: node i of the upper-middle tree
+    // has its children in slots 2i and 2i + 1 (slot 0 is unused)
+    void buildEytzinger() {
+        long n = (long)sortedElements->size();
+        auto image = std::make_shared<EytzingerImage>();
+        size_t slots = (size_t)1 << avl_build::heightOf(n);
+        image->keys.resize(slots);
+        image->used.assign(slots, 0);
+
+        struct Pending {
+            long lo;
+            long hi;
+            size_t slot;
+        };
+        std::vector<Pending> stack;
+        if (n > 0) {
+            stack.push_back({0, n - 1, 1});
+        }
+        while (!stack.empty()) {
+            Pending p = stack.back();
+            stack.pop_back();
+            long mid = avl_build::middle(p.lo, p.hi);
+            image->keys[p.slot] = (*sortedElements)[mid];
+            image->used[p.slot] = 1;
+            if (mid + 1 <= p.hi) {
+                stack.push_back({mid + 1, p.hi, 2 * p.slot + 1});
+            }
+            if (p.lo <= mid - 1) {
+                stack.push_back({p.lo, mid - 1, 2 * p.slot});
+            }
+        }
+        nodesAllocated += n;
+        eytzinger = std::move(image);
+    }
+
+    bool searchEytzinger(const T& key) const {
+        const std::vector<T>& keys = eytzinger->keys;
+        const std::vector<unsigned char>& used = eytzinger->used;
+        size_t i = 1;
+        while (i < keys.size() && used[i]) {
+            if (comp(key, keys[i])) {
+                i = 2 * i;
+            } else if (comp(keys[i], key)) {
+                i = 2 * i + 1;
+            } else {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Build a fresh tree over all of sortedElements, in an arena with
+    // room for "slack" more nodes
+    AVLNode<T>* rebuildAll(size_t slack = 0) {
+        ScopedTimer timer(rebuildTime);
+        liveNodes = sortedElements->size();
+        stale = false;
+        if constexpr (kEytzinger) {
+            buildEytzinger();
+            return nullptr;
+        }
+
+        // Keep the old arena alive until the visit counts are copied
+        std::shared_ptr<NodeArena<T>> old = std::move(arena);
+        if (sortedElements->empty()) {
+            dropArena(old);
+            rebuildIndex();
+            return nullptr;
+        }
+        arena = std::make_shared<NodeArena<T>>(sortedElements->size() + slack);
+        if (successorLinks) {
+            arena->enableSuccessors();
+        }
+        AVLNode<T>* fresh = buildBalancedTree();
+        rebuildIndex();
+        markDeadSlots(fresh);
+        if (countVisits && root) {
+            carryVisits(root, fresh);
+        }
+        dropArena(old);
+        return fresh;
+    }
+
+    // Rebuild the autotuned kernel's structure over sortedElements
+    void rebuildIndex() {
+        if (searchKernel == SearchKernel::Pointer) {
+            index.reset();
+        } else {
+            index = std::make_shared<const SearchIndex<T, Compare>>(
+                *sortedElements, searchKernel, tuneReport.cpu.avx2, comp);
+        }
+    }
+
+    // Give the tree an arena no copy shares, before writing to its
+    // nodes (visit counters); rebuildAll carries the counts over
+    void detachArena() {
+        if (root && arena.use_count() > 1) {
+            root = rebuildAll();
+        }
+    }
+
+    // Release an arena; remember it if a clone keeps it alive
+    void dropArena(std::shared_ptr<NodeArena<T>>& old) {
+        if (old && old.use_count() > 1) {
+            sharedDropped.erase(
+                std::remove_if(sharedDropped.begin(), sharedDropped.end(),
+                               [](const std::weak_ptr<NodeArena<T>>& w) { return w.expired(); }),
+                sharedDropped.end());
+            sharedDropped.push_back(old);
+        }
+        old.reset();
+    }
+
+    // Called whenever sortedElements changes: stale cursors notice the
+    // version, and the weighted tree no longer matches the keys
+    void keysChanged() {
+        keysVersion++;
+        weighted.reset();
+    }
+
+    void sortUnique(std::vector<T>& keys) const {
+        std::sort(keys.begin(), keys.end(), comp);
+        keys.resize(set_kernels::uniqueSorted(keys.data(), keys.size(), comp));
+    }
+
+    // Merge the sorted, duplicate-free "batch" into the keys (or take
+    // it out of them) into a new vector, then rebuild once. Every key
+    // of the batch is reported to the recorder and checkpointer.
+    void mergeBatch(const Keys& batch, bool insert) {
+        flushRebuild();
+        if (batch.empty()) {
+            return;
+        }
+        uint64_t start = recorder ? recorder->now() : 0;
+        std::vector<char> changed;
+        if (recorder || checkpointer) {
+            changed.resize(batch.size());
+            for (size_t i = 0; i < batch.size(); i++) {
+                changed[i] = (rankOf(batch[i]) >= 0) != insert;
+            }
+        }
+
+        const Keys& old = *sortedElements;
+        auto merged = std::make_shared<Keys>(old.size() + (insert ? batch.size() : 0));
+        size_t count = insert
+            ? parallelSetUnion(old.data(), old.size(), batch.data(), batch.size(),
+                               merged->data(), parallelism, comp)
+            : parallelSetDifference(old.data(), old.size(), batch.data(), batch.size(),
+                                    merged->data(), parallelism, comp);
+        merged->resize(count);
+        elementsShifted += count;
+        sortedElements = std::move(merged);
+        keysChanged();
+        if (kLazy) {
+            stale = true;
+        } else {
+            root = rebuildAll();
+        }
+
+        for (size_t i = 0; i < changed.size(); i++) {
+            noteWrite(insert ? TraceOp::Insert : TraceOp::Remove, batch[i], start, changed[i]);
+        }
+    }
+
+    // Give this tree its own copy of the keys before mutating them
+    void detach() {
+        if (sortedElements.use_count() > 1) {
+            sortedElements = std::make_shared<Keys>(*sortedElements);
+        }
+    }
+
+    // Shared key vector of every empty tree, so that default
+    // construction and moves never allocate
+    static const std::shared_ptr<Keys>& emptyElements() {
+        static const std::shared_ptr<Keys> empty = std::make_shared<Keys>();
+        return empty;
+    }
+
+    // First entry of "delta" whose key is not less than "key"
+    typename Delta::const_iterator deltaBound(const Delta& delta, const T& key) const {
+        return std::lower_bound(delta.begin(), delta.end(), key,
+                                [this](const std::pair<T, bool>& e, const T& k) { return comp(e.first, k); });
+    }
+
+    // Heap image of every empty tree (a single unused slot)
+    static const std::shared_ptr<const EytzingerImage>& emptyImage() {
+        static const std::shared_ptr<const EytzingerImage> empty =
+            std::make_shared<EytzingerImage>(EytzingerImage{std::vector<T>(1), {0}});
+        return empty;
+    }
+
+    // State of "key" in a delta: 1 present, 0 absent, -1 no entry
+    int deltaState(const Delta& delta, const T& key) const {
+        auto it = deltaBound(delta, key);
+        if (it == delta.end() || !same(it->first, key)) {
+            return -1;
+        }
+        return it->second ? 1 : 0;
+    }
+
+    // Entries of "older" and "newer" in key order; "newer" wins ties
+    Delta combineDeltas(const Delta& older, const Delta& newer) const {
+        Delta out;
+        out.reserve(older.size() + newer.size());
+        size_t i = 0;
+        size_t j = 0;
+        while (i < older.size() || j < newer.size()) {
+            if (j == newer.size() || (i < older.size() && comp(older[i].first, newer[j].first))) {
+                out.push_back(older[i++]);
+            } else {
+                if (i < older.size() && !comp(newer[j].first, older[i].first)) {
+                    i++;
+                }
+                out.push_back(newer[j++]);
+            }
+        }
+        return out;
+    }
+
+    // Whether the tree holds "key" once the deltas are applied
+    bool containsKey(const T& key) const {
+        int state = deltaState(liveDelta, key);
+        if (state < 0) {
+            state = deltaState(frozenDelta, key);
+        }
+        if (state < 0) {
+            return std::binary_search(sortedElements->begin(), sortedElements->end(), key, comp);
+        }
+        return state == 1;
+    }
+
+    // Record a write in the live delta (no-op if nothing changes)
+    void writeDelta(const T& key, bool present) {
+        if (containsKey(key) == present) {
+            return;
+        }
+        auto it = liveDelta.begin() + (deltaBound(liveDelta, key) - liveDelta.cbegin());
+        if (it != liveDelta.end() && same(it->first, key)) {
+            it->second = present;
+        } else {
+            liveDelta.insert(it, std::make_pair(key, present));
+        }
+        deltaNet += present ? 1 : -1;
+    }
+
+    // Spend one operation's budget on the pending build, starting one
+    // if there are writes to merge in
+    void advanceRebuild(size_t budget) {
+        if (!pending) {
+            if (liveDelta.empty()) {
+                return;
+            }
+            startBuild();
+        }
+        ScopedTimer timer(rebuildTime);
+        if (!pending->builder) {
+            budget = mergeStep(budget);
+        }
+        if (pending->builder && pending->builder->step(budget)) {
+            finishBuild();
+        }
+    }
+
+    // Freeze the live delta and start merging it into a new key vector
+    void startBuild() {
+        frozenDelta.swap(liveDelta);
+        liveDelta.clear();
+        pending.reset(new PendingBuild());
+        size_t added = 0;
+        for (const auto& entry : frozenDelta) {
+            added += entry.second ? 1 : 0;
+        }
+        // Reserved up front, so the builder can keep a pointer to it
+        pending->keys = spareKeys ? std::move(spareKeys) : std::make_shared<Keys>();
+        pending->keys->clear();
+        size_t needed = sortedElements->size() + added;
+        if (pending->keys->capacity() < needed) {
+            pending->keys->reserve(needed + needed / 16);
+        }
+    }
+
+    // Merge up to "budget" keys; returns the unused budget. Creates the
+    // builder once every key is merged.
+    size_t mergeStep(size_t budget) {
+        const Keys& base = *sortedElements;
+        Keys& out = *pending->keys;
+        size_t& i = pending->baseIndex;
+        size_t& j = pending->deltaIndex;
+        for (; budget > 0 && (i < base.size() || j < frozenDelta.size()); budget--) {
+            if (j == frozenDelta.size() || (i < base.size() && comp(base[i], frozenDelta[j].first))) {
+                out.push_back(base[i++]);
+            } else {
+                if (i < base.size() && !comp(frozenDelta[j].first, base[i])) {
+                    i++; // The delta entry replaces this key
+                }
+                if (frozenDelta[j].second) {
+                    out.push_back(frozenDelta[j].first);
+                }
+                j++;
+            }
+        }
+        if (i == base.size() && j == frozenDelta.size()) {
+            elementsShifted += out.size();
+            if (spareArena && spareArena->canHold(out.size())) {
+                pending->arena = std::move(spareArena);
+                pending->arena->clear();
+            } else {
+                // Some slack, so that a growing tree can keep reusing it
+                spareArena.reset();
+                pending->arena = std::make_shared<NodeArena<T>>(out.size() + out.size() / 16 + 1);
+            }
+            if (successorLinks) {
+                pending->arena->enableSuccessors();
+            }
+            // van Emde Boas order needs an O(n) slot table up front,
+            // which would break the per-operation bound
+            NodeOrder order = nodeOrder == NodeOrder::VanEmdeBoas ? NodeOrder::BreadthFirst
+                                                                  : nodeOrder;
+            pending->builder.reset(new TreeBuilder<T>(out.data(), (long)out.size(),
+                                                      *pending->arena, order));
+        }
+        return budget;
+    }
+
+    // Swap the finished tree in; the frozen delta is now part of it
+    void finishBuild() {
+        std::shared_ptr<NodeArena<T>> old = std::move(arena);
+        arena = std::move(pending->arena);
+        root = pending->builder->root();
+        deltaNet -= (long)pending->keys->size() - (long)sortedElements->size();
+        std::shared_ptr<Keys> oldKeys = std::move(sortedElements);
+        sortedElements = std::move(pending->keys);
+        keysChanged();
+        liveNodes = sortedElements->size();
+        nodesAllocated += liveNodes;
+        frozenDelta.clear();
+        pending.reset();
+        // The kernel index catches up at the next full rebuild
+        index.reset();
+        // Keep the old buffers for the next build unless a clone
+        // still uses them
+        if (old && old.use_count() == 1) {
+            spareArena = std::move(old);
+        } else {
+            dropArena(old);
+        }
+        if (oldKeys.use_count() == 1) {
+            spareKeys = std::move(oldKeys);
+        }
+    }
+
+    // Finish the pending build and apply the remaining writes at once
+    // (or, with Lazy, the rebuild the last writes put off)
+    void flushDeltas() {
+        while (pending || !liveDelta.empty()) {
+            advanceRebuild((size_t)-1);
+        }
+        if (stale) {
+            root = rebuildAll();
+        }
+    }
+
+    // Carry the counters over a rebuild so the heatmap survives it.
+    // Hits belong to keys and are copied key by key (both in-order
+    // walks are sorted, so one merge pass is enough). Visits depend on
+    // the shape, so each new node gets the hits of its subtree: the
+    // successful searches that would have passed through it. Misses
+    // seen before the rebuild are dropped.
+    void carryVisits(AVLNode<T>* oldRoot, AVLNode<T>* newRoot) {
+        std::vector<AVLNode<T>*> oldNodes;
+        std::vector<AVLNode<T>*> newNodes;
+        collectInorder(oldRoot, oldNodes);
+        collectInorder(newRoot, newNodes);
+        size_t i = 0;
+        for (AVLNode<T>* node : newNodes) {
+            while (i < oldNodes.size() && comp(oldNodes[i]->key, node->key)) {
+                i++;
+            }
+            if (i < oldNodes.size() && same(oldNodes[i]->key, node->key)) {
+                node->hits.store(oldNodes[i]->hits.load(std::memory_order_relaxed),
+                                 std::memory_order_relaxed);
+            }
+        }
+        sumSubtreeHits(newRoot);
+    }
+
+    // Set each node's visits to the hits in its subtree; returns the
+    // total. Rebuilt trees are O(log n) deep.
+    unsigned sumSubtreeHits(AVLNode<T>* node) {
+        if (!node) {
+            return 0;
+        }
+        unsigned total = node->hits.load(std::memory_order_relaxed) +
+                         sumSubtreeHits(node->left) + sumSubtreeHits(node->right);
+        node->visits.store(total, std::memory_order_relaxed);
+        return total;
+    }
+
+    void collectInorder(AVLNode<T>* node, std::vector<AVLNode<T>*>& out) {
+        if (node) {
+            collectInorder(node->left, out);
+            out.push_back(node);
+            collectInorder(node->right, out);
+        }
+    }
+
+    // Insert into the sorted vector (if not a duplicate)
+    void insertSorted(const T& key) {
+        size_t pos = lowerBound(key);
+        if (pos == sortedElements->size() || !same((*sortedElements)[pos], key)) {
+            detach();
+            elementsShifted += sortedElements->size() - pos;
+            sortedElements->insert(sortedElements->begin() + pos, key);
+            keysChanged();
+        }
+    }
+
+    // Remove from the sorted vector (if present)
+    void eraseSorted(const T& key) {
+        size_t pos = lowerBound(key);
+        if (pos != sortedElements->size() && same((*sortedElements)[pos], key)) {
+            detach();
+            elementsShifted += sortedElements->size() - pos - 1;
+            sortedElements->erase(sortedElements->begin() + pos);
+            keysChanged();
+        }
+    }
+
+    // Insert into the sorted vector, then rebuild
+    AVLNode<T>* insertRebuild(T key) {
+        bool append = sortedElements->empty() || comp(sortedElements->back(), key);
+        if (append && appendInPlace(key)) {
+            return root;
+        }
+        insertSorted(key);
+        // Leave room for the appends that usually follow an append
+        return rebuildAll(append ? sortedElements->size() / 16 + 1 : 0);
+    }
+
+    // Append a key greater than all others without a new arena.
+    // Growing a range by one key keeps its root only if the range had
+    // an even size, so the walk goes down the right spine while that
+    // holds; the first subtree that changes shape is rebuilt from its
+    // own nodes plus one spare slot of the arena. That subtree is the
+    // whole tree whenever n is odd, so a large one is instead rebuilt
+    // by the sequential builder over the same arena: still O(n), but
+    // with no allocation, no page faults and no vector shift.
+    // With visit counting on, the rebuilt subtree's nodes take the hits
+    // of their new keys and visits = hits in their subtree, as after
+    // carryVisits; the nodes above it keep their counts.
+    // Returns false (nothing changed) when the arena is full or shared,
+    // or when successor links would have to be relinked.
+    bool appendInPlace(const T& key) {
+        if constexpr (kEytzinger) {
+            return false;
+        }
+        if (!root || arena.use_count() > 1 || !arena->canHold(arena->size() + 1) ||
+            arena->hasSuccessors()) {
+            return false;
+        }
+        ScopedTimer timer(rebuildTime);
+        detach();
+        sortedElements->push_back(key);
+        keysChanged();
+        const T* keys = sortedElements->data();
+        long last = (long)sortedElements->size() - 1;
+
+        // Ranges of even size keep their root: only the height grows
+        AVLNode<T>** link = &root;
+        long lo = 0;
+        while (*link && (last - lo) % 2 == 0) {
+            (*link)->height = avl_build::heightOf(last - lo + 1);
+            lo = avl_build::middle(lo, last - 1) + 1;
+            link = &(*link)->right;
+        }
+
+        if (last - lo + 1 > (last + 1) / 8) {
+            if (countVisits) {
+                appendPool.clear();
+                collectInorder(root, appendPool);
+                appendHits.resize(appendPool.size());
+                for (size_t i = 0; i < appendPool.size(); i++) {
+                    appendHits[i] = appendPool[i]->hits.load(std::memory_order_relaxed);
+                }
+            }
+            arena->clear();
+            root = buildBalancedTree();
+            if (countVisits) {
+                appendPool.clear();
+                collectInorder(root, appendPool);
+                for (size_t i = 0; i < appendHits.size(); i++) {
+                    appendPool[i]->hits.store(appendHits[i], std::memory_order_relaxed);
+                }
+                sumSubtreeHits(root);
+            }
+            liveNodes++;
+            rebuildIndex();
+            return true;
+        }
+
+        // Rebuild keys[lo..last] from the nodes of the old subtree
+        appendPool.clear();
+        if (*link) {
+            appendPool.push_back(*link);
+        }
+        for (size_t i = 0; i < appendPool.size(); i++) {
+            if (appendPool[i]->left) {
+                appendPool.push_back(appendPool[i]->left);
+            }
+            if (appendPool[i]->right) {
+                appendPool.push_back(appendPool[i]->right);
+            }
+        }
+        if (countVisits) {
+            // Hits by rank in keys[lo..last]; the new key has none
+            appendHits.assign((size_t)(last - lo + 1), 0);
+            for (AVLNode<T>* node : appendPool) {
+                long r = std::lower_bound(keys + lo, keys + last, node->key, comp) - keys;
+                appendHits[(size_t)(r - lo)] = node->hits.load(std::memory_order_relaxed);
+            }
+        }
+        appendPool.push_back(arena->make(key));
+
+        struct Pending {
+            long lo;
+            long hi;
+            AVLNode<T>** link;
+        };
+        Pending stack[130];
+        int top = 0;
+        size_t next = 0;
+        stack[top++] = {lo, last, link};
+        while (top > 0) {
+            Pending p = stack[--top];
+            if (p.lo > p.hi) {
+                *p.link = nullptr;
+                continue;
+            }
+            long mid = avl_build::middle(p.lo, p.hi);
+            AVLNode<T>* node = appendPool[next++];
+            node->key = keys[mid];
+            node->height = avl_build::heightOf(p.hi - p.lo + 1);
+            if (countVisits) {
+                node->hits.store(appendHits[(size_t)(mid - lo)], std::memory_order_relaxed);
+            }
+            *p.link = node;
+            stack[top++] = {mid + 1, p.hi, &node->right};
+            stack[top++] = {p.lo, mid - 1, &node->left};
+        }
+        if (countVisits) {
+            sumSubtreeHits(*link);
+        }
+        liveNodes++;
+        nodesAllocated++;
+        rebuildIndex();
+        return true;
+    }
+
+    // Remove from the sorted vector, then rebuild
+    AVLNode<T>* deleteRebuild(T key) {
+        eraseSorted(key);
+        return rebuildAll();
+    }
+
+    // Lazy: build now if writes have put the rebuild off
+    void refresh() {
+        if (stale) {
+            root = rebuildAll();
+        }
+    }
+
+    // The write and search paths below branch on the policies with
+    // "if constexpr": an Incremental<N> tree goes straight to the delta,
+    // and an Eytzinger tree never checks for one. Only Eager and Lazy
+    // trees with pointer nodes test rebuildBudget at run time.
+    void applyInsert(const T& key) {
+        if constexpr (kIncremental) {
+            writeDelta(key, true);
+            advanceRebuild(rebuildBudget);
+        } else {
+            if constexpr (!kEytzinger) {
+                if (rebuildBudget > 0) {
+                    writeDelta(key, true);
+                    advanceRebuild(rebuildBudget);
+                    return;
+                }
+                if (deadCount > 0) {
+                    insertWithTombstones(key);
+                    return;
+                }
+            }
+            if constexpr (kLazy) {
+                insertSorted(key);
+                stale = true;
+            } else {
+                root = insertRebuild(key);
+            }
+        }
+    }
+
+    void applyRemove(const T& key) {
+        if constexpr (kIncremental) {
+            writeDelta(key, false);
+            advanceRebuild(rebuildBudget);
+        } else {
+            if constexpr (!kEytzinger) {
+                if (rebuildBudget > 0) {
+                    writeDelta(key, false);
+                    advanceRebuild(rebuildBudget);
+                    return;
+                }
+                if (tombstoneThreshold > 0) {
+                    markDead(key);
+                    return;
+                }
+            }
+            if constexpr (kLazy) {
+                eraseSorted(key);
+                stale = true;
+            } else {
+                root = deleteRebuild(key);
+            }
+        }
+    }
+
+    // The deltas take precedence over the tree
+    bool find(const T& key) {
+        if constexpr (kEytzinger) {
+            refresh();
+            return searchEytzinger(key);
+        } else {
+            if (kIncremental || rebuildBudget > 0) {
+                return findIncremental(key);
+            }
+            refresh();
+            if (countVisits) {
+                detachArena();
+            }
+            if (deadCount > 0) {
+                return searchTombstoned(key);
+            }
+            if (index && !countVisits) {
+                return index->contains(*sortedElements, key);
+            }
+            return searchBST(root, key);
+        }
+    }
+
+    bool findIncremental(const T& key) {
+        if (countVisits) {
+            detachArena();
+        }
+        int state = deltaState(liveDelta, key);
+        if (state < 0) {
+            state = deltaState(frozenDelta, key);
+        }
+        bool found = state < 0 ? searchBST(root, key) : state == 1;
+        advanceRebuild(rebuildBudget);
+        return found;
+    }
+
+    // Standard BST search
+    bool searchBST(AVLNode<T>* node, const T& key) {
+        return findNode(node, key) != nullptr;
+    }
+
+    // Node holding "key", or nullptr
+    AVLNode<T>* findNode(AVLNode<T>* node, const T& key) {
+        while (node) {
+            if (countVisits) {
+                node->countVisit();
+            }
+            bool less = comp(key, node->key);
+            bool greater = comp(node->key, key);
+            if (!less && !greater) {
+                if (countVisits) {
+                    node->countHit();
+                }
+                return node;
+            }
+            node = less ? node->left : node->right;
+        }
+        return nullptr;
+    }
+
+    // Tombstones: a hit is a miss if its node's slot is dead. Only a
+    // subtraction and one bit are added to the search, so lookups
+    // keep overlapping their cache misses.
+    bool searchTombstoned(const T& key) {
+        AVLNode<T>* node = findNode(root, key);
+        return node && !testBit(deadSlots, (size_t)(node - arena->slot(0)));
+    }
+
+    // Log one operation if a recorder is attached (integral keys only)
+    void recordOp(TraceOp op, const T& key, uint64_t startNs, bool result) {
+        if constexpr (std::is_integral<T>::value) {
+            recorder->record(op, (int64_t)key, startNs, result);
+        }
+    }
+
+    // Pass a write to the recorder and, if it changed the keys, to the
+    // checkpointer
+    void noteWrite(TraceOp op, const T& key, uint64_t startNs, bool changed) {
+        if (recorder) {
+            recordOp(op, key, startNs, changed);
+        }
+        if constexpr (std::is_trivially_copyable<T>::value) {
+            if (checkpointer && changed) {
+                checkpointer->markDirty(key);
+            }
+        }
+    }
+
+    // For debugging: In-order traversal
+    void inorder(AVLNode<T>* node) {
+        if (node) {
+            inorder(node->left);
+            std::cout << node->key << " ";
+            inorder(node->right);
+        }
+    }
+
+public:
+    explicit AVLTree(const Compare& comp = Compare())
+        : root(nullptr), sortedElements(emptyElements()), eytzinger(emptyImage()),
+          recorder(nullptr), checkpointer(nullptr),
+          comp(comp), stale(false), keysVersion(0),
+          liveNodes(0), nodesAllocated(0), elementsShifted(0),
+          countVisits(false), nodeOrder(NodeOrder::BreadthFirst), parallelism(1),
+          successorLinks(false),
+          deadCount(0), tombstoneThreshold(0),
+          rebuildBudget(Rebuild::nodesPerOp), deltaNet(0),
+          searchKernel(SearchKernel::Pointer), tuneReport()
+    {
+        tuneReport.chosen = SearchKernel::Pointer;
+    }
+
+    // Copies share keys and nodes until one side mutates (see clone).
+    // A pending incremental build is not copied: the copy keeps the
+    // writes in its delta and starts its own build.
+    AVLTree(const AVLTree& other)
+        : root(other.root), sortedElements(other.sortedElements), arena(other.arena),
+          eytzinger(other.eytzinger), recorder(nullptr), checkpointer(nullptr),
+          comp(other.comp), stale(other.stale), keysVersion(0),
+          liveNodes(other.liveNodes), nodesAllocated(0), elementsShifted(0),
+          countVisits(other.countVisits), nodeOrder(other.nodeOrder),
+          parallelism(other.parallelism), successorLinks(other.successorLinks),
+          dead(other.dead), deadSlots(other.deadSlots), deadCount(other.deadCount),
+          tombstoneThreshold(other.tombstoneThreshold),
+          rebuildBudget(other.rebuildBudget),
+          liveDelta(combineDeltas(other.frozenDelta, other.liveDelta)),
+          deltaNet(other.deltaNet),
+          searchKernel(other.searchKernel), index(other.index), tuneReport(other.tuneReport),
+          weighted(other.weighted)
+    {}
+
+    // O(1): steals the storage, leaving "other" empty
+    AVLTree(AVLTree&& other) noexcept
+        : root(other.root), sortedElements(std::move(other.sortedElements)),
+          arena(std::move(other.arena)), eytzinger(other.eytzinger), recorder(other.recorder),
+          checkpointer(other.checkpointer), comp(other.comp), stale(other.stale),
+          keysVersion(other.keysVersion),
+          sharedDropped(std::move(other.sharedDropped)),
+          liveNodes(other.liveNodes), nodesAllocated(other.nodesAllocated),
+          elementsShifted(other.elementsShifted), rebuildTime(other.rebuildTime),
+          countVisits(other.countVisits), nodeOrder(other.nodeOrder),
+          parallelism(other.parallelism), successorLinks(other.successorLinks),
+          dead(std::move(other.dead)), deadSlots(std::move(other.deadSlots)),
+          deadCount(other.deadCount),
+          tombstoneThreshold(other.tombstoneThreshold),
+          rebuildBudget(other.rebuildBudget),
+          liveDelta(std::move(other.liveDelta)), frozenDelta(std::move(other.frozenDelta)),
+          deltaNet(other.deltaNet), pending(std::move(other.pending)),
+          spareArena(std::move(other.spareArena)), spareKeys(std::move(other.spareKeys)),
+          searchKernel(other.searchKernel), index(std::move(other.index)),
+          tuneReport(other.tuneReport), weighted(std::move(other.weighted))
+    {
+        other.root = nullptr;
+        other.sortedElements = emptyElements();
+        other.recorder = nullptr;
+        other.checkpointer = nullptr;
+        other.keysVersion++;
+        other.liveNodes = 0;
+        other.eytzinger = emptyImage();
+        other.stale = false;
+        other.liveDelta.clear();
+        other.frozenDelta.clear();
+        other.deltaNet = 0;
+        other.dead.clear();
+        other.deadSlots.clear();
+        other.deadCount = 0;
+    }
+
+    AVLTree& operator=(const AVLTree& other) {
+        if (this != &other) {
+            AVLTree copy(other);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+
+    AVLTree& operator=(AVLTree&& other) noexcept {
+        if (this != &other) {
+            root = other.root;
+            sortedElements = std::move(other.sortedElements);
+            arena = std::move(other.arena);
+            eytzinger = other.eytzinger;
+            recorder = other.recorder;
+            checkpointer = other.checkpointer;
+            comp = other.comp;
+            stale = other.stale;
+            keysVersion = std::max(keysVersion, other.keysVersion) + 1;
+            sharedDropped = std::move(other.sharedDropped);
+            liveNodes = other.liveNodes;
+            nodesAllocated = other.nodesAllocated;
+            elementsShifted = other.elementsShifted;
+            rebuildTime = other.rebuildTime;
+            countVisits = other.countVisits;
+            nodeOrder = other.nodeOrder;
+            parallelism = other.parallelism;
+            successorLinks = other.successorLinks;
+            dead = std::move(other.dead);
+            deadSlots = std::move(other.deadSlots);
+            deadCount = other.deadCount;
+            tombstoneThreshold = other.tombstoneThreshold;
+            rebuildBudget = other.rebuildBudget;
+            liveDelta = std::move(other.liveDelta);
+            frozenDelta = std::move(other.frozenDelta);
+            deltaNet = other.deltaNet;
+            pending = std::move(other.pending);
+            spareArena = std::move(other.spareArena);
+            spareKeys = std::move(other.spareKeys);
+            searchKernel = other.searchKernel;
+            index = std::move(other.index);
+            tuneReport = other.tuneReport;
+            weighted = std::move(other.weighted);
+
+            other.root = nullptr;
+            other.sortedElements = emptyElements();
+            other.recorder = nullptr;
+            other.checkpointer = nullptr;
+            other.keysVersion++;
+            other.liveNodes = 0;
+            other.eytzinger = emptyImage();
+            other.stale = false;
+            other.liveDelta.clear();
+            other.frozenDelta.clear();
+            other.deltaNet = 0;
+            other.dead.clear();
+            other.deadSlots.clear();
+            other.deadCount = 0;
+        }
+        return *this;
+    }
+
+    // Nodes and keys go away with their shared owners: dropping the
+    // last reference to the arena frees the whole tree at once
+    ~AVLTree() = default;
+
+    // Cheap copy that shares all storage until the first mutation
+    // of either tree; with visit counting on, that includes the first
+    // search. The clone does not inherit the recorder or the
+    // checkpointer.
+    AVLTree clone() const {
+        return AVLTree(*this);
+    }
+
+    // Public Insert
+    void insert(T key) {
+        if (!recorder && !checkpointer) {
+            applyInsert(key);
+            return;
+        }
+        uint64_t start = recorder ? recorder->now() : 0;
+        size_t before = size();
+        applyInsert(key);
+        noteWrite(TraceOp::Insert, key, start, size() != before);
+    }
+
+    // Public Remove
+    void remove(T key) {
+        if (!recorder && !checkpointer) {
+            applyRemove(key);
+            return;
+        }
+        uint64_t start = recorder ? recorder->now() : 0;
+        size_t before = size();
+        applyRemove(key);
+        noteWrite(TraceOp::Remove, key, start, size() != before);
+    }
+
+    // Public Search
+    bool search(T key) {
+        if (!recorder) {
+            return find(key);
+        }
+        uint64_t start = recorder->now();
+        bool found = find(key);
+        recordOp(TraceOp::Search, key, start, found);
+        return found;
+    }
+
+    // Search a batch of keys sorted in ascending order and write one
+    // bool per key to "out". Instead of starting each key at the root,
+    // one pass over the sorted keys gallops from the previous key's
+    // position: O(m log(n/m)) for m keys, reading the keys front to
+    // back. If a path sink is given, path(i, rank) is called for every
+    // node on the upper-middle search path of key i, root first,
+    // where rank is the node's index in getSortedElements(). With
+    // incremental rebuilds the path is that of the current tree,
+    // before the pending writes. Not recorded and no visits counted.
+    template <typename QueryIt, typename OutIt, typename PathSink = NoPathSink>
+    OutIt searchSorted(QueryIt first, QueryIt last, OutIt out, PathSink&& path = PathSink()) const {
+        const Keys& keys = *sortedElements;
+        const bool hasDelta = !liveDelta.empty() || !frozenDelta.empty();
+        Delta delta = hasDelta ? combineDeltas(frozenDelta, liveDelta) : Delta();
+        auto d = delta.cbegin();
+        std::ptrdiff_t pos = 0;
+        for (size_t i = 0; first != last; ++first, ++i) {
+            const T& key = *first;
+            pos = gallopLowerBound(keys.begin(), keys.end(), pos, key, comp);
+            bool found = pos < (std::ptrdiff_t)keys.size() && !comp(key, keys[pos])
+                         && !isDead((size_t)pos);
+            if constexpr (!std::is_same<std::decay_t<PathSink>, NoPathSink>::value) {
+                upperMiddlePath((std::ptrdiff_t)keys.size(), pos, found,
+                                [&](std::ptrdiff_t rank) { path(i, (size_t)rank); });
+            }
+            if (hasDelta) {
+                while (d != delta.cend() && comp(d->first, key)) {
+                    ++d;
+                }
+                if (d != delta.cend() && !comp(key, d->first)) {
+                    found = d->second;
+                }
+            }
+            *out++ = found;
+        }
+        return out;
+    }
+
+    // Same for a vector of sorted keys
+    std::vector<bool> searchSorted(const std::vector<T>& keys) const {
+        std::vector<bool> found(keys.size());
+        searchSorted(keys.begin(), keys.end(), found.begin());
+        return found;
+    }
+
+    // Build a second tree over the current keys, shaped by how often
+    // each one is looked up: freq[i] is the weight of
+    // getSortedElements()[i]. Each range is split at the key holding
+    // the middle of its total weight (Mehlhorn's bisection rule), so a
+    // key with a share p of the lookups sits at depth about log2(1/p)
+    // and the expected search cost is within a constant of the optimal
+    // BST. Every key counts one lookup more than given, so unseen keys
+    // stay O(log n) deep. The canonical tree (getRoot, getSearchPath)
+    // is unchanged; searchWeighted() uses the new one until the keys
+    // change, then falls back to search() until the next build.
+    void buildWeighted(const std::vector<double>& freq) {
+        const Keys& keys = *sortedElements;
+        long n = (long)keys.size();
+        if (freq.size() != keys.size()) {
+            weighted.reset();
+            return;
+        }
+        std::vector<double> prefix(n + 1, 0.0);
+        for (long i = 0; i < n; i++) {
+            prefix[i + 1] = prefix[i] + std::max(freq[i], 0.0) + 1.0;
+        }
+
+        auto tree = std::make_shared<WeightedTree>();
+        tree->arena = std::make_shared<NodeArena<T>>((size_t)n);
+        tree->root = nullptr;
+        struct Pending {
+            long lo;
+            long hi;
+            AVLNode<T>** link;
+        };
+        std::vector<Pending> stack;
+        if (n > 0) {
+            stack.push_back({0, n - 1, &tree->root});
+        }
+        while (!stack.empty()) {
+            Pending p = stack.back();
+            stack.pop_back();
+            double half = (prefix[p.lo] + prefix[p.hi + 1]) / 2;
+            long r = (long)(std::upper_bound(prefix.begin() + p.lo + 1, prefix.begin() + p.hi + 1, half)
+                            - prefix.begin()) - 1;
+            AVLNode<T>* node = tree->arena->make(keys[r]);
+            *p.link = node;
+            if (r + 1 <= p.hi) {
+                stack.push_back({r + 1, p.hi, &node->right});
+            }
+            if (p.lo <= r - 1) {
+                stack.push_back({p.lo, r - 1, &node->left});
+            }
+        }
+        // Nodes were made in preorder, so walking the slots backwards
+        // sees every child before its parent
+        for (long i = n - 1; i >= 0; i--) {
+            AVLNode<T>* node = tree->arena->slot(i);
+            node->height = 1 + std::max(height(node->left), height(node->right));
+        }
+        nodesAllocated += n;
+        weighted = std::move(tree);
+    }
+
+    // Same with the lookups counted by the canonical tree since visit
+    // counting was enabled (see setVisitCounting): each key weighs the
+    // searches that found it (AVLNode::hits)
+    void buildWeightedFromVisits() {
+        static_assert(!kEytzinger, "the Eytzinger layout has no nodes");
+        refresh();
+        std::vector<AVLNode<T>*> nodes;
+        collectInorder(root, nodes);
+        std::vector<double> freq(nodes.size());
+        for (size_t i = 0; i < nodes.size(); i++) {
+            freq[i] = (double)nodes[i]->hits.load(std::memory_order_relaxed);
+        }
+        buildWeighted(freq);
+    }
+
+    // Search the weighted tree (search() if there is none). Writes not
+    // yet in the tree are answered by the deltas; nothing is recorded.
+    bool searchWeighted(const T& key) {
+        if (!weighted) {
+            return search(key);
+        }
+        int state = deltaState(liveDelta, key);
+        if (state < 0) {
+            state = deltaState(frozenDelta, key);
+        }
+        if (state >= 0) {
+            return state == 1;
+        }
+        const AVLNode<T>* node = weighted->root;
+        while (node) {
+            bool less = comp(key, node->key);
+            bool greater = comp(node->key, key);
+            if (!less && !greater) {
+                return deadCount == 0 || rankOf(key) >= 0;
+            }
+            node = less ? node->left : node->right;
+        }
+        return false;
+    }
+
+    // Root of the weighted tree, or nullptr if it is not built or the
+    // keys have changed since
+    const AVLNode<T>* getWeightedRoot() const {
+        return weighted ? weighted->root : nullptr;
+    }
+
+    // Shape queries on the canonical tree. Its shape depends only on
+    // the number of keys, so they work on ranks with O(log n)
+    // arithmetic after one binary search and read no nodes. They
+    // describe the tree over getSortedElements(), so writes still in
+    // an incremental rebuild's delta are not included.
+
+    // Depth of "key" (root = 0), or -1 if it is not in the tree. A
+    // search for the key makes depthOf(key) + 1 comparisons.
+    int depthOf(const T& key) const {
+        long r = rankOf(key);
+        return r < 0 ? -1 : avl_build::depthOfRank((long)sortedElements->size(), r);
+    }
+
+    // Key of the ancestor of "key" at depth "level" (the key itself at
+    // its own depth), or nullptr if "key" is absent or not that deep
+    const T* ancestorAt(const T& key, int level) const {
+        long r = rankOf(key);
+        if (r < 0 || level < 0) {
+            return nullptr;
+        }
+        long a = avl_build::ancestorRank((long)sortedElements->size(), r, level);
+        return a < 0 ? nullptr : &(*sortedElements)[a];
+    }
+
+    // Key of the lowest common ancestor of "a" and "b", or nullptr if
+    // either is absent
+    const T* lca(const T& a, const T& b) const {
+        long ra = rankOf(a);
+        long rb = rankOf(b);
+        if (ra < 0 || rb < 0) {
+            return nullptr;
+        }
+        return &(*sortedElements)[avl_build::lcaRank((long)sortedElements->size(), ra, rb)];
+    }
+
+    // Finger search: a cursor remembers the rank of the last key it
+    // looked up and searches outward from there, in O(log d) for a key
+    // d ranks away. Reads keep it valid; a write that changes the
+    // sorted keys bumps the tree's version, and the next lookup starts
+    // over with a full search. Writes still in an incremental rebuild's
+    // delta are checked on every lookup. Like an iterator, a cursor
+    // must not outlive its tree. Lookups are not recorded and count no
+    // visits.
+    class Cursor {
+    public:
+        explicit Cursor(const AVLTree& tree)
+            : tree(&tree), position(0), version(0), positioned(false)
+        {}
+
+        bool find(const T& key) {
+            const Keys& keys = *tree->sortedElements;
+            if (positioned && version == tree->keysVersion) {
+                position = (size_t)fingerLowerBound(keys.begin(), keys.end(),
+                                                    (std::ptrdiff_t)position, key, tree->comp);
+            } else {
+                position = tree->lowerBound(key);
+                version = tree->keysVersion;
+                positioned = true;
+            }
+            int state = tree->deltaState(tree->liveDelta, key);
+            if (state < 0) {
+                state = tree->deltaState(tree->frozenDelta, key);
+            }
+            if (state >= 0) {
+                return state == 1;
+            }
+            return position < keys.size() && !tree->comp(key, keys[position])
+                   && !tree->isDead(position);
+        }
+
+        // Rank in getSortedElements() of the first key not less than
+        // the last key looked up
+        size_t rank() const {
+            return position;
+        }
+
+        // Whether the next lookup can start from rank()
+        bool valid() const {
+            return positioned && version == tree->keysVersion;
+        }
+
+    private:
+        const AVLTree* tree;
+        size_t position;
+        unsigned long long version;
+        bool positioned;
+    };
+
+    Cursor cursor() const {
+        return Cursor(*this);
+    }
+
+    // Spread rebuilds over operations: every insert, remove and search
+    // does at most "nodesPerOp" units of rebuild work (a key merged or
+    // a node built), so no single call pays for a whole rebuild. A
+    // build of n keys completes after about 2n / nodesPerOp calls,
+    // while the delta answers for the writes made meanwhile.
+    // 0 (the default) rebuilds on every write; switching to it applies
+    // the pending writes first. An Incremental<N> tree stays incremental:
+    // 0 only applies the pending writes. Visit counts are not carried
+    // over by incremental rebuilds.
+    void setIncrementalRebuild(size_t nodesPerOp) {
+        static_assert(!kEytzinger, "incremental rebuilds build pointer nodes");
+        if (deadCount > 0) {
+            compactTombstones();
+        }
+        if (kIncremental && nodesPerOp == 0) {
+            flushDeltas();
+            return;
+        }
+        if (nodesPerOp == 0) {
+            flushDeltas();
+            spareArena.reset();
+            spareKeys.reset();
+            rebuildIndex();
+        }
+        rebuildBudget = nodesPerOp;
+    }
+
+    // Complete the pending incremental build (or the rebuild put off
+    // by Lazy) and apply all writes, so that the tree and
+    // getSortedElements() hold every key and no removed one
+    void flushRebuild() {
+        if (deadCount > 0) {
+            compactTombstones();
+        }
+        flushDeltas();
+    }
+
+    // Tombstones: remove() only marks the key dead in a bitmap, in
+    // O(log n), and the tree keeps it as a separator; searches, scans
+    // and size() skip dead keys. Once more than "maxDeadFraction" of
+    // the keys are dead, one pass drops them and the tree is rebuilt.
+    // An insert of a dead key clears its bit; any other insert drops
+    // the dead keys first, since it shifts ranks anyway. 0 (the
+    // default) turns tombstones off and compacts now. Applies while
+    // writes rebuild at once (not with setIncrementalRebuild).
+    void setTombstones(double maxDeadFraction) {
+        static_assert(!kEytzinger, "tombstones route searches through pointer nodes");
+        tombstoneThreshold = std::max(maxDeadFraction, 0.0);
+        if (tombstoneThreshold == 0 && deadCount > 0) {
+            compactTombstones();
+        }
+    }
+
+    // Log every insert/remove/search to "rec" (nullptr to stop logging).
+    // The recorder must outlive its use by this tree.
+    void setRecorder(TraceRecorder* rec) {
+        static_assert(std::is_integral<T>::value, "traces store integral keys");
+        recorder = rec;
+    }
+
+    // Report every insert/remove that changes the keys to "cp", so its
+    // next writeDelta() holds only the chunks written since the last
+    // checkpoint (nullptr to stop). "cp" must outlive its use by this
+    // tree, and bulkLoad() is not tracked: follow it with writeBase().
+    void setCheckpointer(Checkpointer<T, Compare>* cp) {
+        checkpointer = cp;
+    }
+
+    // Replace the contents with the given keys (any order, duplicates
+    // allowed) and build the tree once, instead of once per key.
+    void bulkLoad(std::vector<T> keys) {
+        sortUnique(keys);
+        pending.reset();
+        spareArena.reset();
+        spareKeys.reset();
+        liveDelta.clear();
+        frozenDelta.clear();
+        deltaNet = 0;
+        dead.clear();
+        deadSlots.clear();
+        deadCount = 0;
+        sortedElements = std::make_shared<Keys>(std::move(keys));
+        keysChanged();
+        root = rebuildAll();
+    }
+
+    // Insert every key of "keys" (any order, duplicates allowed) with
+    // one merge and one rebuild. With setParallelism(), the merge is
+    // split into equal shares of the output by merge-path partitioning
+    // and the rebuild below the top levels runs on the same threads.
+    void insertBatch(std::vector<T> keys) {
+        sortUnique(keys);
+        mergeBatch(keys, true);
+    }
+
+    // Remove every key of "keys" the same way
+    void removeBatch(std::vector<T> keys) {
+        sortUnique(keys);
+        mergeBatch(keys, false);
+    }
+
+    // Insert every key of "other"
+    void unionWith(const AVLTree& other) {
+        AVLTree keys(other); // shares other's keys; settles its pending writes
+        keys.flushRebuild();
+        mergeBatch(*keys.sortedElements, true);
+    }
+
+    // Threads used by insertBatch, removeBatch, unionWith and by every
+    // rebuild of the whole tree (0 = one per core, 1 = the default).
+    // Work is only split into pieces of at least kMergePathMinPiece.
+    void setParallelism(unsigned threads) {
+        parallelism = threads;
+    }
+
+    // Visit every key in [lo, hi) in ascending order
+    template <typename Fn>
+    void forEachInRange(const T& lo, const T& hi, Fn fn) const {
+        forEachBetween(&lo, &hi, fn);
+    }
+
+    // Same with optional bounds: a null lo or hi leaves that end open
+    template <typename Fn>
+    void forEachBetween(const T* lo, const T* hi, Fn fn) const {
+        auto it = sortedElements->begin() + (lo ? lowerBound(*lo) : 0);
+        if (liveDelta.empty() && frozenDelta.empty()) {
+            for (; it != sortedElements->end() && (!hi || comp(*it, *hi)); ++it) {
+                if (!isDead((size_t)(it - sortedElements->begin()))) {
+                    fn(*it);
+                }
+            }
+            return;
+        }
+        // Merge the keys with the deltas' entries in [lo, hi)
+        Delta delta = combineDeltas(frozenDelta, liveDelta);
+        auto d = lo ? deltaBound(delta, *lo) : delta.cbegin();
+        for (;;) {
+            bool baseLeft = it != sortedElements->end() && (!hi || comp(*it, *hi));
+            bool deltaLeft = d != delta.cend() && (!hi || comp(d->first, *hi));
+            if (!baseLeft && !deltaLeft) {
+                break;
+            }
+            if (!deltaLeft || (baseLeft && comp(*it, d->first))) {
+                fn(*it++);
+            } else {
+                if (baseLeft && !comp(d->first, *it)) {
+                    ++it;
+                }
+                if (d->second) {
+                    fn(d->first);
+                }
+                ++d;
+            }
+        }
+    }
+
+    // Current footprint plus cumulative rebuild/shift counters
+    AVLMemoryStats memoryStats() const {
+        AVLMemoryStats stats;
+        stats.elementBytes = sortedElements->size() * sizeof(T);
+        stats.elementCapacityBytes = sortedElements->capacity() * sizeof(T);
+        stats.liveNodes = liveNodes;
+        stats.liveNodeBytes = liveNodes * sizeof(AVLNode<T>);
+        if (arena && arena->hasSuccessors()) {
+            stats.liveNodeBytes += liveNodes * sizeof(AVLNode<T>*);
+        }
+        if constexpr (kEytzinger) {
+            stats.liveNodeBytes = eytzinger->keys.size() * (sizeof(T) + 1);
+        }
+        stats.leakedNodes = 0;
+        stats.pendingReclaimNodes = 0;
+        bool nodesShared = kEytzinger ? eytzinger.use_count() > 1 : arena && arena.use_count() > 1;
+        stats.sharedBytes = (sortedElements.use_count() > 1 ? stats.elementCapacityBytes : 0)
+                            + (nodesShared ? stats.liveNodeBytes : 0);
+        stats.deltaEntries = liveDelta.size() + frozenDelta.size();
+        stats.deadKeys = deadCount;
+        stats.searchIndexBytes = index ? index->sizeInBytes() : 0;
+        stats.weightedNodes = weighted ? weighted->arena->size() : 0;
+        for (const auto& weak : sharedDropped) {
+            if (auto held = weak.lock()) {
+                stats.pendingReclaimNodes += held->size();
+            }
+        }
+        stats.nodesAllocated = nodesAllocated;
+        stats.elementsShifted = elementsShifted;
+        return stats;
+    }
+
+    // Measure every search kernel that supports T on this machine and
+    // switch search() to the fastest. The kernels run on the current
+    // keys, or on an evenly spaced sample of them when the keys exceed
+    // four times the last-level cache: large enough to stay out of
+    // cache like the real tree, small enough to keep startup short.
+    // The choice is kept with the tree (see setSearchKernel) and the
+    // report is returned for logging. Searches with visit counting on,
+    // and incremental rebuilds, keep walking the nodes.
+    AutotuneReport autotune(size_t queries = 20000) {
+        static_assert(!kEytzinger, "autotune picks between layouts of the node tree");
+        flushDeltas();
+        AutotuneReport report;
+        report.cpu = CpuInfo::detect();
+
+        const Keys& keys = *sortedElements;
+        size_t limit = std::max<size_t>(1, 4 * report.cpu.l3Bytes / sizeof(T));
+        Keys sample;
+        if (keys.size() > limit) {
+            sample.reserve(limit);
+            for (size_t i = 0; i < limit; i++) {
+                sample.push_back(keys[i * keys.size() / limit]);
+            }
+        }
+        const Keys& measured = keys.size() > limit ? sample : keys;
+        report.sampleKeys = measured.size();
+
+        // The same pseudo-random keys for every kernel
+        std::vector<T> probes;
+        probes.reserve(measured.empty() ? 0 : queries);
+        uint64_t state = 0x9E3779B97F4A7C15ULL;
+        for (size_t i = 0; i < queries && !measured.empty(); i++) {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            probes.push_back(measured[(size_t)(state >> 33) % measured.size()]);
+        }
+
+        // Best of three passes over the probes, in ns per search
+        auto measure = [&](auto&& contains) {
+            double best = -1.0;
+            size_t hits = 0;
+            for (int pass = 0; pass < 3; pass++) {
+                auto start = std::chrono::steady_clock::now();
+                for (const T& key : probes) {
+                    hits += contains(key) ? 1 : 0;
+                }
+                std::chrono::duration<double, std::nano> took =
+                    std::chrono::steady_clock::now() - start;
+                double ns = probes.empty() ? 0.0 : took.count() / probes.size();
+                if (best < 0 || ns < best) {
+                    best = ns;
+                }
+            }
+            // Every probe is a stored key; a kernel that misses one is broken
+            return hits == 3 * probes.size() ? best : -1.0;
+        };
+
+        NodeArena<T> sampleArena(std::max<size_t>(1, measured.size()));
+        AVLNode<T>* sampleRoot = buildUpperMiddleTree(measured.data(), (long)measured.size(),
+                                                      sampleArena, nodeOrder);
+        report.nsPerSearch[(int)SearchKernel::Pointer] = measure([&](const T& key) {
+            AVLNode<T>* node = sampleRoot;
+            while (node) {
+                bool less = comp(key, node->key);
+                bool greater = comp(node->key, key);
+                if (!less && !greater) {
+                    return true;
+                }
+                node = less ? node->left : node->right;
+            }
+            return false;
+        });
+
+        report.chosen = SearchKernel::Pointer;
+        for (int k = 1; k < kSearchKernelCount; k++) {
+            SearchKernel kernel = (SearchKernel)k;
+            report.nsPerSearch[k] = -1.0;
+            if (!SearchIndex<T, Compare>::supports(kernel)) {
+                continue;
+            }
+            SearchIndex<T, Compare> candidate(measured, kernel, report.cpu.avx2, comp);
+            report.nsPerSearch[k] = measure([&](const T& key) {
+                return candidate.contains(measured, key);
+            });
+            double best = report.nsPerSearch[(int)report.chosen];
+            if (report.nsPerSearch[k] >= 0 && (best < 0 || report.nsPerSearch[k] < best)) {
+                report.chosen = kernel;
+            }
+        }
+
+        tuneReport = report;
+        setSearchKernel(report.chosen);
+        return report;
+    }
+
+    // Use a given kernel for search() (e.g. a choice saved from an
+    // earlier autotune() on the same machine)
+    void setSearchKernel(SearchKernel kernel) {
+        if (!SearchIndex<T, Compare>::supports(kernel)) {
+            return;
+        }
+        if (tuneReport.cpu.l1Bytes == 0) {
+            tuneReport.cpu = CpuInfo::detect();
+        }
+        searchKernel = kernel;
+        tuneReport.chosen = kernel;
+        rebuildIndex();
+    }
+
+    SearchKernel getSearchKernel() const {
+        return searchKernel;
+    }
+
+    // Measurements behind the current kernel (all zero before autotune)
+    const AutotuneReport& autotuneReport() const {
+        return tuneReport;
+    }
+
+    // Count how often searches visit each node and find each key (see
+    // AVLNode::visits and AVLNode::hits)
+    void setVisitCounting(bool enabled) {
+        countVisits = enabled;
+    }
+
+    // Arena layout of the nodes (see buildUpperMiddleTree); the
+    // tree is rebuilt in the new order right away
+    void setNodeOrder(NodeOrder order) {
+        if (order != nodeOrder) {
+            nodeOrder = order;
+            root = rebuildAll();
+        }
+    }
+
+    NodeOrder getNodeOrder() const {
+        return nodeOrder;
+    }
+
+    // Build every tree with successor links (see NodeArena), at one
+    // pointer per node, so that forEachNodeInRange follows each node
+    // to the next in key order instead of walking the tree. The tree
+    // is rebuilt right away.
+    void setSuccessorLinks(bool enabled) {
+        static_assert(!kEytzinger, "the Eytzinger layout has no nodes");
+        if (enabled != successorLinks) {
+            successorLinks = enabled;
+            root = rebuildAll();
+        }
+    }
+
+    // Visit the nodes with keys in [lo, hi) in ascending order, skipping
+    // dead keys. These are the nodes of the current tree: writes still
+    // in an incremental delta are not among them (see flushRebuild).
+    template <typename Fn>
+    void forEachNodeInRange(const T& lo, const T& hi, Fn fn) {
+        forEachNodeBetween(&lo, &hi, fn);
+    }
+
+    // Same with optional bounds: a null lo or hi leaves that end open.
+    // With successor links, the first node is found by one descent and
+    // the rest by following links, fetching the node after next while
+    // "fn" runs; otherwise an explicit stack walks the tree in order.
+    template <typename Fn>
+    void forEachNodeBetween(const T* lo, const T* hi, Fn fn) {
+        static_assert(!kEytzinger, "the Eytzinger layout has no nodes");
+        refresh();
+        auto visit = [&](AVLNode<T>* node) {
+            if (deadCount == 0 || !testBit(deadSlots, (size_t)(node - arena->slot(0)))) {
+                fn(node);
+            }
+        };
+
+        if (root && arena->hasSuccessors()) {
+            AVLNode<T>* node = nullptr;
+            for (AVLNode<T>* n = root; n;) {
+                if (lo && comp(n->key, *lo)) {
+                    n = n->right;
+                } else {
+                    node = n;
+                    n = n->left;
+                }
+            }
+            while (node && (!hi || comp(node->key, *hi))) {
+                AVLNode<T>* next = arena->successor(node);
+                if (next) {
+                    __builtin_prefetch(next);
+                    arena->prefetchSuccessor(next);
+                }
+                visit(node);
+                node = next;
+            }
+            return;
+        }
+
+        std::vector<AVLNode<T>*> stack;
+        for (AVLNode<T>* n = root; n;) {
+            if (lo && comp(n->key, *lo)) {
+                n = n->right;
+            } else {
+                stack.push_back(n);
+                n = n->left;
+            }
+        }
+        while (!stack.empty()) {
+            AVLNode<T>* node = stack.back();
+            stack.pop_back();
+            if (hi && !comp(node->key, *hi)) {
+                break;
+            }
+            visit(node);
+            for (AVLNode<T>* n = node->right; n; n = n->left) {
+                stack.push_back(n);
+            }
+        }
+    }
+
+    // Zero every node's visit and hit counters
+    void resetVisits() {
+        detachArena();
+        std::vector<AVLNode<T>*> nodes;
+        collectInorder(root, nodes);
+        for (AVLNode<T>* node : nodes) {
+            node->visits.store(0, std::memory_order_relaxed);
+            node->hits.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Timing of full rebuilds, or of incremental steps (last, total, count)
+    const ProfileStat& rebuildStats() const {
+        return rebuildTime;
+    }
+
+    // Number of keys stored
+    size_t size() const {
+        return (size_t)((long)sortedElements->size() + deltaNet) - deadCount;
+    }
+
+    // Print Inorder
+    void printInorder() {
+        inorder(root);
+        std::cout << std::endl;
+    }
+
+    // Access the root (for drawing, etc.)
+    AVLNode<T>* getRoot() {
+        static_assert(!kEytzinger, "the Eytzinger layout has no nodes");
+        refresh();
+        return root;
+    }
+
+    // The keys in ascending order; rank i is sortedElements[i]. With
+    // incremental rebuilds these are the keys of the current tree,
+    // without the writes still in the delta (see flushRebuild); with
+    // tombstones they include dead keys until the next compaction.
+    // To export the set, use liveKeys() or forEachBetween.
+    const Keys& getSortedElements() const {
+        return *sortedElements;
+    }
+
+    // The keys that search() finds, in ascending order: writes still
+    // in an incremental rebuild's delta are merged in and dead keys
+    // are left out. Use this, not getSortedElements(), to copy the set
+    // into another structure.
+    std::vector<T> liveKeys() const {
+        std::vector<T> keys;
+        keys.reserve(size());
+        forEachBetween(nullptr, nullptr, [&keys](const T& key) { keys.push_back(key); });
+        return keys;
+    }
+
+    // Return the path (node pointers) visited during a search for "key"
+    // This is used for highlighting the path in the SFML drawing.
+    std::vector<AVLNode<T>*> getSearchPath(T key) {
+        static_assert(!kEytzinger, "the Eytzinger layout has no nodes");
+        refresh();
+        if (countVisits) {
+            detachArena();
+        }
+        std::vector<AVLNode<T>*> path;
+        AVLNode<T>* current = root;
+        while (current) {
+            path.push_back(current);
+            if (countVisits) {
+                current->countVisit();
+            }
+            if (same(current->key, key)) {
+                if (countVisits) {
+                    current->countHit();
+                }
+                break;
+            }
+            else if (comp(key, current->key)) {
+                current = current->left;
+            }
+            else {
+                current = current->right;
+            }
+        }
+        return path;
+    }
+};
+
+#endif // AVLTREE_H
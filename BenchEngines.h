@@ -0,0 +1,222 @@
+#ifndef BENCH_ENGINES_H
+#define BENCH_ENGINES_H
+
+#include <algorithm>
+#include <memory>
+#include <set>
+#include <unordered_set>
+#include <vector>
+
+#include "AVLTree.h"
+#include "BinarySearch.h"
+#include "ConcurrentTree.h"
+
+// ----------------------------------------------------
+// Engines
+//   Each engine exposes the same small interface so that the
+//   benchmark workloads and trace replays run identical operation
+//   streams on all of them. Engines are templates on the key type:
+//   the benchmark uses int, trace replays the recorded int64_t keys.
+//   Only engines with threadSafe set may be called from several
+//   threads at once.
+// ----------------------------------------------------
+template <typename Tree>
+struct BasicAVLTreeEngine {
+    typedef typename Tree::Keys::value_type Key;
+    Tree tree;
+    // Every write rebuilds the whole tree, so write-heavy runs are capped
+    static const bool rebuildsOnWrite = true;
+    static const bool threadSafe = false;
+    void bulkLoad(const std::vector<Key>& keys) { tree.bulkLoad(keys); }
+    bool contains(Key key) { return tree.search(key); }
+    void insert(Key key) { tree.insert(key); }
+    void erase(Key key) { tree.remove(key); }
+    bool canScan() const { return true; }
+    long long scan(Key lo, Key hi) {
+        long long sum = 0;
+        tree.forEachInRange(lo, hi, [&](Key k) { sum += (long long)k; });
+        return sum;
+    }
+};
+
+template <typename Key = int>
+struct AVLTreeEngine : BasicAVLTreeEngine<AVLTree<Key>> {
+    static const char* name() { return "AVLTree"; }
+};
+
+// Same tree with its nodes laid out in van Emde Boas order
+template <typename Key = int>
+struct AVLTreeVebEngine : AVLTreeEngine<Key> {
+    AVLTreeVebEngine() { this->tree.setNodeOrder(NodeOrder::VanEmdeBoas); }
+    static const char* name() { return "AVLTree_veb"; }
+};
+
+// Same tree rebuilding incrementally, 256 nodes per operation
+template <typename Key = int>
+struct AVLTreeIncrementalEngine
+    : BasicAVLTreeEngine<AVLTree<Key, avl_policy::SortedVector, avl_policy::PointerNodes,
+                                 avl_policy::Incremental<256>>> {
+    static const char* name() { return "AVLTree_incremental"; }
+    static const bool rebuildsOnWrite = false;
+};
+
+// Read-optimized combination: keys in heap order, rebuilt on the
+// first search after a batch of writes
+template <typename Key = int>
+struct AVLTreeEytzingerEngine
+    : BasicAVLTreeEngine<AVLTree<Key, avl_policy::SortedVector, avl_policy::Eytzinger,
+                                 avl_policy::Lazy>> {
+    static const char* name() { return "AVLTree_eytzinger_lazy"; }
+};
+
+// Same tree searching with whichever kernel autotune() measured fastest
+template <typename Key = int>
+struct AVLTreeAutotunedEngine : AVLTreeEngine<Key> {
+    static const char* name() { return "AVLTree_autotuned"; }
+    void bulkLoad(const std::vector<Key>& keys) {
+        this->tree.bulkLoad(keys);
+        this->tree.autotune();
+    }
+};
+
+template <typename Key = int>
+struct StdSetEngine {
+    std::set<Key> s;
+    static const char* name() { return "std::set"; }
+    static const bool rebuildsOnWrite = false;
+    static const bool threadSafe = false;
+    void bulkLoad(const std::vector<Key>& keys) { s.insert(keys.begin(), keys.end()); }
+    bool contains(Key key) { return s.find(key) != s.end(); }
+    void insert(Key key) { s.insert(key); }
+    void erase(Key key) { s.erase(key); }
+    bool canScan() const { return true; }
+    long long scan(Key lo, Key hi) {
+        long long sum = 0;
+        for (auto it = s.lower_bound(lo); it != s.end() && *it < hi; ++it) {
+            sum += (long long)*it;
+        }
+        return sum;
+    }
+};
+
+template <typename Key = int>
+struct SortedVectorEngine {
+    std::vector<Key> v;
+    static const char* name() { return "sorted_vector"; }
+    static const bool rebuildsOnWrite = false;
+    static const bool threadSafe = false;
+    void bulkLoad(const std::vector<Key>& keys) {
+        v = keys;
+        std::sort(v.begin(), v.end());
+        v.erase(std::unique(v.begin(), v.end()), v.end());
+    }
+    bool contains(Key key) {
+        auto it = std::lower_bound(v.begin(), v.end(), key);
+        return it != v.end() && *it == key;
+    }
+    void insert(Key key) {
+        auto it = std::lower_bound(v.begin(), v.end(), key);
+        if (it == v.end() || *it != key) {
+            v.insert(it, key);
+        }
+    }
+    void erase(Key key) {
+        auto it = std::lower_bound(v.begin(), v.end(), key);
+        if (it != v.end() && *it == key) {
+            v.erase(it);
+        }
+    }
+    bool canScan() const { return true; }
+    long long scan(Key lo, Key hi) {
+        long long sum = 0;
+        for (auto it = std::lower_bound(v.begin(), v.end(), lo); it != v.end() && *it < hi; ++it) {
+            sum += (long long)*it;
+        }
+        return sum;
+    }
+};
+
+// Sorted vector probed with the upper-middle binarySearch: the
+// reference for AVLTree's search path, without any nodes
+template <typename Key = int>
+struct BinarySearchEngine : SortedVectorEngine<Key> {
+    static const char* name() { return "binary_search"; }
+    bool contains(Key key) {
+        return binarySearch(this->v.begin(), this->v.end(), key) != -1;
+    }
+};
+
+// Sorted vector probed with the branchless, prefetching search
+template <typename Key = int>
+struct BranchlessSearchEngine : SortedVectorEngine<Key> {
+    static const char* name() { return "branchless_search"; }
+    bool contains(Key key) {
+        return prefetchSearch(this->v.begin(), this->v.end(), key) != -1;
+    }
+};
+
+template <typename Key = int>
+struct UnorderedSetEngine {
+    std::unordered_set<Key> s;
+    static const char* name() { return "std::unordered_set"; }
+    static const bool rebuildsOnWrite = false;
+    static const bool threadSafe = false;
+    void bulkLoad(const std::vector<Key>& keys) { s.insert(keys.begin(), keys.end()); }
+    bool contains(Key key) { return s.count(key) != 0; }
+    void insert(Key key) { s.insert(key); }
+    void erase(Key key) { s.erase(key); }
+    // No ordered traversal: range scans are not reported for this engine
+    bool canScan() const { return false; }
+    long long scan(Key, Key) { return 0; }
+};
+
+// Relaxed-balance tree with optimistic lock coupling (see
+// ConcurrentTree.h). The tree can be neither copied nor moved, so the
+// engine holds it by pointer to stay assignable.
+template <typename Key = int>
+struct ConcurrentAVLTreeEngine {
+    std::unique_ptr<ConcurrentAVLTree<Key>> tree{new ConcurrentAVLTree<Key>()};
+    static const char* name() { return "ConcurrentAVLTree"; }
+    static const bool rebuildsOnWrite = false;
+    static const bool threadSafe = true;
+    void bulkLoad(const std::vector<Key>& keys) {
+        for (Key key : keys) {
+            tree->insert(key);
+        }
+    }
+    bool contains(Key key) { return tree->search(key); }
+    void insert(Key key) { tree->insert(key); }
+    void erase(Key key) { tree->remove(key); }
+    // No range iteration that is safe next to writers
+    bool canScan() const { return false; }
+    long long scan(Key, Key) { return 0; }
+};
+
+// ----------------------------------------------------
+// Engine registry
+//   forEachEngine<Key>(fn) calls fn(EngineTag<Engine>(), id) for every
+//   engine above, in the order the benchmark reports them; "id" is the
+//   short name tools accept on the command line. A new engine only
+//   needs a line here to reach the benchmark and the trace replayer.
+// ----------------------------------------------------
+template <typename Engine>
+struct EngineTag {
+    typedef Engine type;
+};
+
+template <typename Key, typename Fn>
+void forEachEngine(Fn&& fn) {
+    fn(EngineTag<AVLTreeEngine<Key>>(), "avl");
+    fn(EngineTag<AVLTreeVebEngine<Key>>(), "avl_veb");
+    fn(EngineTag<AVLTreeIncrementalEngine<Key>>(), "avl_incremental");
+    fn(EngineTag<AVLTreeEytzingerEngine<Key>>(), "avl_eytzinger_lazy");
+    fn(EngineTag<AVLTreeAutotunedEngine<Key>>(), "avl_autotuned");
+    fn(EngineTag<StdSetEngine<Key>>(), "set");
+    fn(EngineTag<SortedVectorEngine<Key>>(), "vector");
+    fn(EngineTag<BinarySearchEngine<Key>>(), "binary");
+    fn(EngineTag<BranchlessSearchEngine<Key>>(), "branchless");
+    fn(EngineTag<UnorderedSetEngine<Key>>(), "unordered");
+    fn(EngineTag<ConcurrentAVLTreeEngine<Key>>(), "concurrent");
+}
+
+#endif // BENCH_ENGINES_H
@@ -0,0 +1,298 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "BenchEngines.h"
+
+using namespace std;
+
+// ----------------------------------------------------
+// Heap accounting
+//   Every allocation carries a small header with its size so that
+//   the live byte count can be sampled around a bulk load.
+// ----------------------------------------------------
+// Atomic because the tree's worker threads (setParallelism) allocate
+// too; relaxed, since only the totals around a measurement matter
+static atomic<size_t> liveHeapBytes{0};
+
+static const size_t kHeapHeader = 16; // keeps max_align_t alignment
+
+void* operator new(size_t size) {
+    void* raw = malloc(size + kHeapHeader);
+    if (!raw) {
+        throw std::bad_alloc();
+    }
+    *static_cast<size_t*>(raw) = size;
+    liveHeapBytes.fetch_add(size, memory_order_relaxed);
+    return static_cast<char*>(raw) + kHeapHeader;
+}
+
+void operator delete(void* p) noexcept {
+    if (!p) return;
+    // Step back through an integer so the compiler does not flag the
+    // header access as out of bounds of the user object
+    void* raw = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(p) - kHeapHeader);
+    liveHeapBytes.fetch_sub(*static_cast<size_t*>(raw), memory_order_relaxed);
+    free(raw);
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete[](void* p) noexcept { operator delete(p); }
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+void operator delete[](void* p, size_t) noexcept { operator delete(p); }
+
+// Types aligned beyond max_align_t (alignas(64) counters, say) come
+// through these. The header takes a whole alignment unit, so the
+// object after it keeps the alignment it asked for.
+static size_t alignedHeader(align_val_t align) {
+    return max(kHeapHeader, (size_t)align);
+}
+
+void* operator new(size_t size, align_val_t align) {
+    size_t header = alignedHeader(align);
+    // aligned_alloc wants a multiple of the alignment
+    size_t total = (size + header + (size_t)align - 1) / (size_t)align * (size_t)align;
+    void* raw = aligned_alloc((size_t)align, total);
+    if (!raw) {
+        throw std::bad_alloc();
+    }
+    *static_cast<size_t*>(raw) = size;
+    liveHeapBytes.fetch_add(size, memory_order_relaxed);
+    return static_cast<char*>(raw) + header;
+}
+
+void operator delete(void* p, align_val_t align) noexcept {
+    if (!p) return;
+    void* raw = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(p) - alignedHeader(align));
+    liveHeapBytes.fetch_sub(*static_cast<size_t*>(raw), memory_order_relaxed);
+    free(raw);
+}
+
+void* operator new[](size_t size, align_val_t align) { return operator new(size, align); }
+void operator delete[](void* p, align_val_t align) noexcept { operator delete(p, align); }
+void operator delete(void* p, size_t, align_val_t align) noexcept { operator delete(p, align); }
+void operator delete[](void* p, size_t, align_val_t align) noexcept { operator delete(p, align); }
+
+// ----------------------------------------------------
+// Results
+// ----------------------------------------------------
+struct Result {
+    string engine;
+    string workload;
+    size_t n;
+    size_t ops;
+    double nsPerOp;
+    double bytesPerKey;
+};
+
+struct Options {
+    vector<size_t> sizes = {1000, 10000, 100000, 1000000};
+    size_t ops = 200000;
+    // Upper bound on (writes * n) for engines that rebuild on every write
+    size_t rebuildBudget = 4000000;
+    string csvPath;
+    string jsonPath;
+    unsigned seed = 12345;
+};
+
+// Keeps the optimizer from discarding lookups
+static volatile long long benchSink = 0;
+
+typedef chrono::steady_clock BenchClock;
+
+static double elapsedNs(BenchClock::time_point start) {
+    return (double)chrono::duration_cast<chrono::nanoseconds>(BenchClock::now() - start).count();
+}
+
+// ----------------------------------------------------
+// Workloads
+//   Keys stored are the even numbers 0, 2, ..., 2(n-1), so an odd
+//   query is always a miss and an odd insert always grows the set.
+// ----------------------------------------------------
+template <typename Engine>
+void runEngine(size_t n, const Options& opt, vector<Result>& out) {
+    mt19937 rng(opt.seed);
+
+    vector<int> keys(n);
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = (int)(2 * i);
+    }
+    shuffle(keys.begin(), keys.end(), rng);
+
+    uniform_int_distribution<int> anyKey(0, (int)(2 * n - 1));
+    uniform_int_distribution<int> anyRank(0, (int)n - 1);
+    uniform_int_distribution<int> percent(0, 99);
+
+    // Bulk load (also gives the memory footprint)
+    {
+        Engine e;
+        size_t before = liveHeapBytes.load(memory_order_relaxed);
+        auto start = BenchClock::now();
+        e.bulkLoad(keys);
+        double ns = elapsedNs(start);
+        double bytes = (double)(liveHeapBytes.load(memory_order_relaxed) - before);
+        out.push_back({Engine::name(), "bulk_load", n, n, ns / n, bytes / n});
+    }
+
+    Engine e;
+    e.bulkLoad(keys);
+
+    // Mixed read/write ratios; 100 means read-only lookups
+    const int readPercents[] = {100, 95, 50};
+    for (int readPercent : readPercents) {
+        size_t ops = opt.ops;
+        if (Engine::rebuildsOnWrite && readPercent < 100) {
+            size_t writes = max<size_t>(1, opt.rebuildBudget / n);
+            ops = min(ops, writes * 100 / (size_t)(100 - readPercent));
+        }
+
+        // Generate the stream up front so RNG cost is not timed
+        vector<pair<int, int>> stream(ops); // (kind, key): 0 read, 1 insert, 2 erase
+        for (auto& op : stream) {
+            if (percent(rng) < readPercent) {
+                op = make_pair(0, anyKey(rng));
+            } else if (percent(rng) < 50) {
+                op = make_pair(1, 2 * anyRank(rng) + 1);
+            } else {
+                op = make_pair(2, 2 * anyRank(rng));
+            }
+        }
+
+        long long hits = 0;
+        auto start = BenchClock::now();
+        for (const auto& op : stream) {
+            if (op.first == 0) {
+                hits += e.contains(op.second);
+            } else if (op.first == 1) {
+                e.insert(op.second);
+            } else {
+                e.erase(op.second);
+            }
+        }
+        double ns = elapsedNs(start);
+        benchSink = benchSink + hits;
+
+        string name = readPercent == 100 ? "lookup" : "mixed_r" + to_string(readPercent);
+        out.push_back({Engine::name(), name, n, ops, ns / ops, 0.0});
+
+        // Restore the initial contents for the next workload
+        e = Engine();
+        e.bulkLoad(keys);
+    }
+
+    // Range scans of about 100 keys each
+    if (e.canScan()) {
+        size_t ops = max<size_t>(1, opt.ops / 10);
+        vector<int> starts(ops);
+        for (auto& s : starts) {
+            s = anyKey(rng);
+        }
+
+        long long sum = 0;
+        auto start = BenchClock::now();
+        for (int lo : starts) {
+            sum += e.scan(lo, lo + 200);
+        }
+        double ns = elapsedNs(start);
+        benchSink = benchSink + sum;
+        out.push_back({Engine::name(), "range_scan_100", n, ops, ns / ops, 0.0});
+    }
+}
+
+// ----------------------------------------------------
+// Output
+// ----------------------------------------------------
+static void writeCsv(ostream& os, const vector<Result>& results) {
+    os << "engine,workload,n,ops,ns_per_op,bytes_per_key\n";
+    for (const auto& r : results) {
+        os << r.engine << "," << r.workload << "," << r.n << "," << r.ops << ","
+           << r.nsPerOp << "," << r.bytesPerKey << "\n";
+    }
+}
+
+static void writeJson(ostream& os, const vector<Result>& results) {
+    os << "[\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto& r = results[i];
+        os << "  {\"engine\": \"" << r.engine << "\", \"workload\": \"" << r.workload
+           << "\", \"n\": " << r.n << ", \"ops\": " << r.ops
+           << ", \"ns_per_op\": " << r.nsPerOp
+           << ", \"bytes_per_key\": " << r.bytesPerKey << "}"
+           << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    os << "]\n";
+}
+
+static vector<size_t> parseSizes(const string& list) {
+    vector<size_t> sizes;
+    stringstream ss(list);
+    string item;
+    while (getline(ss, item, ',')) {
+        if (!item.empty()) {
+            sizes.push_back((size_t)strtoull(item.c_str(), nullptr, 10));
+        }
+    }
+    return sizes;
+}
+
+static void printUsage(const char* prog) {
+    cout << "Usage: " << prog << " [--sizes 1000,10000,...] [--ops N]"
+         << " [--rebuild-budget N] [--seed N] [--csv FILE] [--json FILE]" << endl;
+}
+
+// ----------------------------------------------------
+// Main
+// ----------------------------------------------------
+int main(int argc, char** argv) {
+    Options opt;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--sizes" && hasValue) {
+            opt.sizes = parseSizes(argv[++i]);
+        } else if (arg == "--ops" && hasValue) {
+            opt.ops = (size_t)strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--rebuild-budget" && hasValue) {
+            opt.rebuildBudget = (size_t)strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--seed" && hasValue) {
+            opt.seed = (unsigned)strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--csv" && hasValue) {
+            opt.csvPath = argv[++i];
+        } else if (arg == "--json" && hasValue) {
+            opt.jsonPath = argv[++i];
+        } else {
+            printUsage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    vector<Result> results;
+    for (size_t n : opt.sizes) {
+        if (n == 0) continue;
+        forEachEngine<int>([&](auto tag, const char*) {
+            runEngine<typename decltype(tag)::type>(n, opt, results);
+        });
+        cerr << "done n=" << n << endl;
+    }
+
+    writeCsv(cout, results);
+    if (!opt.csvPath.empty()) {
+        ofstream csv(opt.csvPath);
+        writeCsv(csv, results);
+    }
+    if (!opt.jsonPath.empty()) {
+        ofstream json(opt.jsonPath);
+        writeJson(json, results);
+    }
+    return 0;
+}
@@ -1,44 +1,33 @@
 #include <iostream>
 #include <vector>
 
-using namespace std;
+#include "AVLTree.h"
+#include "BinarySearch.h"
 
-int binarySearch(const vector<int>& arr, int target) {
-    int low = 0;
-    int high = arr.size() - 1;
-    vector<int> path; // Store visited indices
+using namespace std;
 
-    while (low <= high) {
-        // --- Changed this line to pick the "upper middle" ---
-        int mid = (low + high + 1) / 2;
+// Check that the binary search probes exactly the nodes that the
+// special AVL tree visits, for every target in and around the array
+bool verifyAgainstTree(const vector<int>& arr) {
+    AVLTree<int> tree;
+    tree.bulkLoad(arr);
 
-        path.push_back(mid); // Store the index visited
+    for (int target = arr.front() - 1; target <= arr.back() + 1; target++) {
+        vector<int> probed;
+        binarySearch(arr.begin(), arr.end(), target, std::less<int>(),
+                     [&](ptrdiff_t index) { probed.push_back(arr[index]); });
 
-        if (arr[mid] == target) {
-            // Print path
-            cout << "Path taken: ";
-            for (int index : path) {
-                cout << arr[index] << " ";
+        vector<AVLNode<int>*> path = tree.getSearchPath(target);
+        if (path.size() != probed.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < path.size(); i++) {
+            if (path[i]->key != probed[i]) {
+                return false;
             }
-            cout << endl;
-            return mid; // Found the target
-        } 
-        else if (arr[mid] < target) {
-            low = mid + 1; // Move right
-        } 
-        else {
-            high = mid - 1; // Move left
         }
     }
-
-    // Print path even if target isn't found
-    cout << "Path taken: ";
-    for (int index : path) {
-        cout << arr[index] << " ";
-    }
-    cout << endl;
-
-    return -1; // Target not found
+    return true;
 }
 
 int main() {
@@ -49,13 +38,26 @@ int main() {
         85, 90, 95, 100, 110
     };
 
+    cout << (verifyAgainstTree(arr)
+             ? "Search paths match the special AVL tree"
+             : "Search paths DIFFER from the special AVL tree") << endl;
+
     int target;
     while (true) {
         cout << "Enter the element to search (0 to exit): ";
         cin >> target;
         if (target == 0) break;
 
-        int index = binarySearch(arr, target);
+        PathBuffer<64> path; // Store visited indices
+        ptrdiff_t index = binarySearch(arr.begin(), arr.end(), target, std::less<int>(), path);
+
+        // Print path, whether or not the target was found
+        cout << "Path taken: ";
+        for (size_t i = 0; i < path.count; i++) {
+            cout << arr[path.indices[i]] << " ";
+        }
+        cout << endl;
+
         if (index != -1) {
             cout << "Element " << target << " found at index " << index << endl;
         } else {
@@ -64,4 +66,4 @@ int main() {
     }
 
     return 0;
-}
\ No newline at end of file
+}
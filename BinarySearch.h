@@ -0,0 +1,264 @@
+#ifndef BINARY_SEARCH_H
+#define BINARY_SEARCH_H
+
+#include <cstddef>
+#include <functional>
+#include <iterator>
+
+// ----------------------------------------------------
+// Binary search library
+//   binarySearch follows the "upper middle" rule of the special AVL
+//   tree, so the indices it probes are exactly the nodes on the tree's
+//   search path. Nothing is allocated or printed: a path sink, if
+//   given, receives each probed index.
+//
+//   The branchless, prefetching and batch variants answer the same
+//   question (index of "target" or -1) faster, but probe a different
+//   sequence of indices.
+// ----------------------------------------------------
+
+// Default path sink: ignores the path
+struct NoPathSink {
+    void operator()(std::ptrdiff_t) const {}
+};
+
+// Path sink that keeps the first N probed indices
+template <size_t N>
+struct PathBuffer {
+    std::ptrdiff_t indices[N];
+    size_t count = 0;
+
+    void operator()(std::ptrdiff_t index) {
+        if (count < N) {
+            indices[count++] = index;
+        }
+    }
+};
+
+// Index of "target" in the sorted range [first, last), or -1.
+// For an even count, probe the "upper" middle: (low + high + 1) / 2
+template <typename RandomIt, typename T,
+          typename Compare = std::less<>, typename PathSink = NoPathSink>
+std::ptrdiff_t binarySearch(RandomIt first, RandomIt last, const T& target,
+                            Compare comp = Compare(), PathSink&& path = PathSink())
+{
+    std::ptrdiff_t low = 0;
+    std::ptrdiff_t high = (last - first) - 1;
+
+    while (low <= high) {
+        std::ptrdiff_t mid = (low + high + 1) / 2;
+        path(mid);
+
+        if (comp(first[mid], target)) {
+            low = mid + 1;      // Move right
+        } else if (comp(target, first[mid])) {
+            high = mid - 1;     // Move left
+        } else {
+            return mid;         // Found the target
+        }
+    }
+    return -1;
+}
+
+// Lower bound without data-dependent branches: the loop runs exactly
+// ceil(log2(n)) times and the step is a conditional move
+template <typename RandomIt, typename T, typename Compare = std::less<>>
+std::ptrdiff_t branchlessLowerBound(RandomIt first, RandomIt last, const T& target,
+                                    Compare comp = Compare())
+{
+    std::ptrdiff_t n = last - first;
+    if (n == 0) {
+        return 0;
+    }
+    std::ptrdiff_t base = 0;
+    while (n > 1) {
+        std::ptrdiff_t half = n / 2;
+        base = comp(first[base + half], target) ? base + half : base;
+        n -= half;
+    }
+    return base + (comp(first[base], target) ? 1 : 0);
+}
+
+// Index of "target", or -1, using branchlessLowerBound
+template <typename RandomIt, typename T, typename Compare = std::less<>>
+std::ptrdiff_t branchlessSearch(RandomIt first, RandomIt last, const T& target,
+                                Compare comp = Compare())
+{
+    std::ptrdiff_t i = branchlessLowerBound(first, last, target, comp);
+    return (i < last - first && !comp(target, first[i])) ? i : -1;
+}
+
+// Branchless search that prefetches both possible next probes, so
+// the memory latency of the next step overlaps with this one
+template <typename RandomIt, typename T, typename Compare = std::less<>>
+std::ptrdiff_t prefetchSearch(RandomIt first, RandomIt last, const T& target,
+                              Compare comp = Compare())
+{
+    std::ptrdiff_t n = last - first;
+    if (n == 0) {
+        return -1;
+    }
+    std::ptrdiff_t base = 0;
+    while (n > 1) {
+        std::ptrdiff_t half = n / 2;
+        __builtin_prefetch(&first[base + half / 2]);
+        __builtin_prefetch(&first[base + half + half / 2]);
+        base = comp(first[base + half], target) ? base + half : base;
+        n -= half;
+    }
+    std::ptrdiff_t i = base + (comp(first[base], target) ? 1 : 0);
+    return (i < last - first && !comp(target, first[i])) ? i : -1;
+}
+
+// Search every key of [queriesFirst, queriesLast) and write its index
+// (or -1) to "out". Queries are processed in groups that advance in
+// lockstep, so the cache misses of a whole group are in flight at once.
+template <typename RandomIt, typename QueryIt, typename OutIt,
+          typename Compare = std::less<>>
+OutIt batchSearch(RandomIt first, RandomIt last,
+                  QueryIt queriesFirst, QueryIt queriesLast,
+                  OutIt out, Compare comp = Compare())
+{
+    const std::ptrdiff_t kGroup = 16;
+    const std::ptrdiff_t size = last - first;
+
+    while (queriesFirst != queriesLast) {
+        QueryIt group[kGroup];
+        std::ptrdiff_t base[kGroup];
+        std::ptrdiff_t count = 0;
+        for (; count < kGroup && queriesFirst != queriesLast; ++count, ++queriesFirst) {
+            group[count] = queriesFirst;
+            base[count] = 0;
+        }
+
+        std::ptrdiff_t n = size;
+        while (n > 1) {
+            std::ptrdiff_t half = n / 2;
+            for (std::ptrdiff_t q = 0; q < count; q++) {
+                __builtin_prefetch(&first[base[q] + half / 2]);
+                __builtin_prefetch(&first[base[q] + half + half / 2]);
+            }
+            for (std::ptrdiff_t q = 0; q < count; q++) {
+                base[q] = comp(first[base[q] + half], *group[q]) ? base[q] + half : base[q];
+            }
+            n -= half;
+        }
+
+        for (std::ptrdiff_t q = 0; q < count; q++) {
+            std::ptrdiff_t i = -1;
+            if (size > 0) {
+                i = base[q] + (comp(first[base[q]], *group[q]) ? 1 : 0);
+                if (i == size || comp(*group[q], first[i])) {
+                    i = -1;
+                }
+            }
+            *out++ = i;
+        }
+    }
+    return out;
+}
+
+// Lower bound of "target" in [first, last), knowing that every key
+// before first + from is less than it: gallop from "from" in steps of
+// 1, 2, 4, ... and binary-search the last step. Costs O(log d)
+// comparisons when the answer is d keys past "from".
+template <typename RandomIt, typename T, typename Compare = std::less<>>
+std::ptrdiff_t gallopLowerBound(RandomIt first, RandomIt last, std::ptrdiff_t from,
+                                const T& target, Compare comp = Compare())
+{
+    const std::ptrdiff_t size = last - first;
+    const std::ptrdiff_t kWindow = 16;
+    // Dense batches: the answer is usually within a few keys, so count
+    // the keys below "target" in the next window without branching
+    if (from + kWindow <= size && !comp(first[from + kWindow - 1], target)) {
+        std::ptrdiff_t count = 0;
+        for (std::ptrdiff_t i = 0; i < kWindow; i++) {
+            count += comp(first[from + i], target) ? 1 : 0;
+        }
+        return from + count;
+    }
+    std::ptrdiff_t low = from;
+    std::ptrdiff_t high = from;
+    for (std::ptrdiff_t step = 1; high < size && comp(first[high], target); step *= 2) {
+        low = high + 1;
+        high += step;
+    }
+    if (high > size) {
+        high = size;
+    }
+    return low + branchlessLowerBound(first + low, first + high, target, comp);
+}
+
+// Lower bound of "target" in [first, last), searching outward from
+// index "hint" in either direction: O(log d) comparisons when the
+// answer is d keys away from the hint
+template <typename RandomIt, typename T, typename Compare = std::less<>>
+std::ptrdiff_t fingerLowerBound(RandomIt first, RandomIt last, std::ptrdiff_t hint,
+                                const T& target, Compare comp = Compare())
+{
+    const std::ptrdiff_t size = last - first;
+    if (hint < 0) {
+        hint = 0;
+    }
+    if (hint < size && comp(first[hint], target)) {
+        return gallopLowerBound(first, last, hint + 1, target, comp);
+    }
+    // The answer is at or before the hint: gallop backwards
+    std::ptrdiff_t high = hint < size ? hint : size;
+    std::ptrdiff_t low = 0;
+    for (std::ptrdiff_t step = 1; high - step >= 0; step *= 2) {
+        if (comp(first[high - step], target)) {
+            low = high - step + 1;
+            break;
+        }
+        high -= step;
+    }
+    return low + branchlessLowerBound(first + low, first + high, target, comp);
+}
+
+// Search the queries [queriesFirst, queriesLast), which must be sorted
+// by "comp", in one forward pass: each query gallops from the previous
+// one's position. m queries over n keys take O(m log(n/m))
+// comparisons, and the keys are read front to back, so dense batches
+// run at the speed of a merge. Writes the index of each query (or -1)
+// to "out".
+template <typename RandomIt, typename QueryIt, typename OutIt,
+          typename Compare = std::less<>>
+OutIt sortedBatchSearch(RandomIt first, RandomIt last,
+                        QueryIt queriesFirst, QueryIt queriesLast,
+                        OutIt out, Compare comp = Compare())
+{
+    const std::ptrdiff_t size = last - first;
+    std::ptrdiff_t pos = 0;
+    for (; queriesFirst != queriesLast; ++queriesFirst) {
+        pos = gallopLowerBound(first, last, pos, *queriesFirst, comp);
+        *out++ = (pos < size && !comp(*queriesFirst, first[pos])) ? pos : -1;
+    }
+    return out;
+}
+
+// Replay the upper-middle search path of binarySearch from its result
+// alone: "rank" is the lower bound of the target among "size" keys and
+// "found" says whether the key there equals it. Only indices are
+// compared, so no key is read.
+template <typename PathSink>
+void upperMiddlePath(std::ptrdiff_t size, std::ptrdiff_t rank, bool found, PathSink&& path)
+{
+    std::ptrdiff_t low = 0;
+    std::ptrdiff_t high = size - 1;
+
+    while (low <= high) {
+        std::ptrdiff_t mid = (low + high + 1) / 2;
+        path(mid);
+
+        if (mid < rank) {
+            low = mid + 1;
+        } else if (mid == rank && found) {
+            return;
+        } else {
+            high = mid - 1;
+        }
+    }
+}
+
+#endif // BINARY_SEARCH_H
@@ -0,0 +1,486 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// ----------------------------------------------------
+// Checkpoint file format
+//   "<path>.base" holds every key, split into chunks of consecutive
+//   keys; the first key of each chunk is its fence. A chunk keeps its
+//   key range [fence i, fence i+1) until the next base, however many
+//   keys it gains or loses.
+//   "<path>.delta.<n>" (n = 1, 2, ...) holds the full new contents of
+//   the chunks written since delta n - 1. The latest copy of a chunk
+//   wins, so recovery reads each chunk from exactly one file.
+//
+//   Layout of both: CheckpointFileHeader, one CheckpointChunk per
+//   chunk, the keys; a base ends with the fences of all its chunks.
+// ----------------------------------------------------
+enum class CheckpointKind : uint32_t {
+    Base = 1,
+    Delta = 2
+};
+
+#pragma pack(push, 1)
+struct CheckpointFileHeader {
+    char magic[8];        // "AVLCKPT\0"
+    uint32_t version;
+    uint32_t keySize;
+    uint32_t kind;        // CheckpointKind
+    uint32_t reserved;
+    uint64_t baseId;      // a delta only applies to the base with its id
+    uint64_t sequence;    // 0 for the base, n for delta n
+    uint64_t chunkCount;  // entries in the chunk table
+    uint64_t baseChunks;  // chunks of the base
+};
+
+struct CheckpointChunk {
+    uint64_t index;       // chunk of the base
+    uint64_t keyCount;
+    uint64_t offset;      // file offset of the keys
+};
+#pragma pack(pop)
+
+static const uint32_t kCheckpointVersion = 1;
+
+// ----------------------------------------------------
+// Checkpointer
+//   Tracks which chunks of the last base were written to (the tree
+//   calls markDirty on every insert and remove, see
+//   AVLTree::setCheckpointer) and writes only those in a delta file.
+//   Recovery and compaction stream the chain chunk by chunk, in key
+//   order, reading each chunk from the newest file that holds it.
+//
+//   Files are written to "<name>.tmp" and renamed into place, so a
+//   crash leaves either the old or the new file.
+// ----------------------------------------------------
+template <typename T, typename Compare = std::less<T>>
+class Checkpointer {
+    static_assert(std::is_trivially_copyable<T>::value, "checkpoints store raw keys");
+
+public:
+    explicit Checkpointer(const std::string& path, size_t chunkKeys = 4096,
+                          Compare comp = Compare())
+        : path(path), chunkKeys(std::max<size_t>(1, chunkKeys)), comp(comp),
+          baseId(0), nextSequence(1), fences(1), dirty(1, 0)
+    {}
+
+    // Note a write to "key" (called by the tree)
+    void markDirty(const T& key) {
+        dirty[chunkOf(key)] = 1;
+    }
+
+    // Write a full snapshot of "tree" and start a new delta chain.
+    // Deltas of the previous chain are deleted once the base is in place.
+    template <typename Tree>
+    bool writeBase(const Tree& tree) {
+        std::vector<T> keys;
+        keys.reserve(tree.size());
+        tree.forEachBetween(nullptr, nullptr, [&](const T& key) { keys.push_back(key); });
+        if (!writeBaseFile(keys, newBaseId())) {
+            return false;
+        }
+        removeDeltasFrom(1);
+        return true;
+    }
+
+    // Write the chunks changed since the last checkpoint to the next
+    // delta file. Returns the number of chunks written (0 means no
+    // file was needed), or -1 on an I/O error.
+    template <typename Tree>
+    long writeDelta(const Tree& tree) {
+        if (baseId == 0) {
+            return writeBase(tree) ? (long)fences.size() : -1;
+        }
+        std::vector<uint64_t> chunks;
+        for (size_t i = 0; i < dirty.size(); i++) {
+            if (dirty[i]) {
+                chunks.push_back(i);
+            }
+        }
+        if (chunks.empty()) {
+            return 0;
+        }
+
+        // Current contents of every dirty chunk, from its key range
+        std::vector<CheckpointChunk> table(chunks.size());
+        std::vector<T> keys;
+        uint64_t offset = sizeof(CheckpointFileHeader) + chunks.size() * sizeof(CheckpointChunk);
+        for (size_t c = 0; c < chunks.size(); c++) {
+            size_t i = chunks[c];
+            size_t before = keys.size();
+            const T* lo = i == 0 ? nullptr : &fences[i];
+            const T* hi = i + 1 == fences.size() ? nullptr : &fences[i + 1];
+            tree.forEachBetween(lo, hi, [&](const T& key) { keys.push_back(key); });
+            table[c].index = i;
+            table[c].keyCount = keys.size() - before;
+            table[c].offset = offset + before * sizeof(T);
+        }
+
+        std::string name = deltaName(nextSequence);
+        std::FILE* out = std::fopen((name + ".tmp").c_str(), "wb");
+        if (!out) {
+            return -1;
+        }
+        CheckpointFileHeader header = makeHeader(CheckpointKind::Delta, baseId, nextSequence,
+                                                 table.size(), fences.size());
+        bool ok = std::fwrite(&header, sizeof(header), 1, out) == 1
+                  && writeAll(out, table.data(), table.size())
+                  && writeAll(out, keys.data(), keys.size());
+        ok = std::fclose(out) == 0 && ok;
+        if (!ok || std::rename((name + ".tmp").c_str(), name.c_str()) != 0) {
+            return -1;
+        }
+        nextSequence++;
+        std::fill(dirty.begin(), dirty.end(), 0);
+        return (long)chunks.size();
+    }
+
+    // Rebuild "tree" from the base and its deltas, and continue the
+    // chain from there. Returns false if there is no readable base.
+    // The chain ends at the first missing, unreadable or torn delta; that
+    // delta and every later one are deleted, so the deltas written
+    // next cannot be followed by stale ones of the same base.
+    template <typename Tree>
+    bool recover(Tree& tree) {
+        std::vector<T> keys;
+        Chain chain;
+        if (!openChain(chain)) {
+            return false;
+        }
+        bool ok = streamChain(chain, [&](const T* data, size_t count) {
+            keys.insert(keys.end(), data, data + count);
+        });
+        if (ok) {
+            tree.bulkLoad(std::move(keys));
+            baseId = chain.baseId;
+            fences = chain.fences;
+            dirty.assign(fences.size(), 0);
+            nextSequence = chain.files.size();
+        }
+        closeChain(chain);
+        if (ok) {
+            removeDeltasFrom(nextSequence);
+        }
+        return ok;
+    }
+
+    // Fold the delta chain into a new base, re-split into chunks of
+    // chunkKeys keys, and delete the deltas. Unwritten dirty chunks
+    // stay dirty (mapped onto the new chunks).
+    bool compact() {
+        Chain chain;
+        if (!openChain(chain)) {
+            return false;
+        }
+        std::vector<T> keys;
+        bool ok = streamChain(chain, [&](const T* data, size_t count) {
+            keys.insert(keys.end(), data, data + count);
+        });
+        closeChain(chain);
+        if (!ok) {
+            return false;
+        }
+
+        std::vector<T> oldFences = fences;
+        std::vector<unsigned char> oldDirty = dirty;
+        if (!writeBaseFile(keys, newBaseId())) {
+            return false;
+        }
+        removeDeltasFrom(1);
+        if (oldFences.size() == oldDirty.size()) {
+            for (size_t i = 0; i < oldDirty.size(); i++) {
+                if (!oldDirty[i]) {
+                    continue;
+                }
+                size_t first = i == 0 ? 0 : chunkOf(oldFences[i]);
+                size_t last = i + 1 == oldFences.size() ? dirty.size() - 1 : chunkOf(oldFences[i + 1]);
+                for (size_t c = first; c <= last; c++) {
+                    dirty[c] = 1;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Chunks that the next delta would write
+    size_t dirtyChunks() const {
+        return (size_t)std::count(dirty.begin(), dirty.end(), 1);
+    }
+
+    size_t chunkCount() const {
+        return fences.size();
+    }
+
+    // Deltas written on top of the current base
+    size_t deltaCount() const {
+        return nextSequence - 1;
+    }
+
+private:
+    // One open file of the chain; files[0] is the base
+    struct Chain {
+        uint64_t baseId = 0;
+        std::vector<T> fences;
+        std::vector<std::FILE*> files;
+        // Newest copy of each chunk: (file, entry)
+        std::vector<std::pair<size_t, CheckpointChunk>> latest;
+    };
+
+    std::string path;
+    size_t chunkKeys;
+    Compare comp;
+    uint64_t baseId;                     // 0 until a base is written or recovered
+    uint64_t nextSequence;
+    std::vector<T> fences;               // fences[i] = first key of chunk i (fences[0] unused)
+    std::vector<unsigned char> dirty;    // per chunk
+
+    std::string baseName() const {
+        return path + ".base";
+    }
+
+    std::string deltaName(uint64_t sequence) const {
+        return path + ".delta." + std::to_string(sequence);
+    }
+
+    static uint64_t newBaseId() {
+        uint64_t id = (uint64_t)std::chrono::system_clock::now().time_since_epoch().count();
+        return id == 0 ? 1 : id;
+    }
+
+    CheckpointFileHeader makeHeader(CheckpointKind kind, uint64_t id, uint64_t sequence,
+                                    uint64_t chunkCount, uint64_t baseChunks) const {
+        CheckpointFileHeader header;
+        std::memcpy(header.magic, "AVLCKPT", 8);
+        header.version = kCheckpointVersion;
+        header.keySize = sizeof(T);
+        header.kind = (uint32_t)kind;
+        header.reserved = 0;
+        header.baseId = id;
+        header.sequence = sequence;
+        header.chunkCount = chunkCount;
+        header.baseChunks = baseChunks;
+        return header;
+    }
+
+    size_t chunkOf(const T& key) const {
+        return (size_t)(std::upper_bound(fences.begin() + 1, fences.end(), key, comp)
+                        - (fences.begin() + 1));
+    }
+
+    // Delete "<path>.delta.<n>" for every n >= first. The directory is
+    // listed rather than probing n = first, first + 1, ..., so files
+    // past a gap in the numbering go too.
+    void removeDeltasFrom(uint64_t first) const {
+        namespace fs = std::filesystem;
+        fs::path prefix(deltaName(0));
+        std::string stem = prefix.filename().string();
+        stem.pop_back();  // "<name>.delta."
+        fs::path dir = prefix.parent_path().empty() ? fs::path(".") : prefix.parent_path();
+        std::error_code error;
+        std::vector<fs::path> stale;
+        for (fs::directory_iterator it(dir, error), end; !error && it != end; it.increment(error)) {
+            std::string name = it->path().filename().string();
+            if (name.size() <= stem.size() || name.compare(0, stem.size(), stem) != 0) {
+                continue;
+            }
+            std::string digits = name.substr(stem.size());
+            if (digits.size() > 19 || digits.find_first_not_of("0123456789") != std::string::npos) {
+                continue;
+            }
+            if (std::stoull(digits) >= first) {
+                stale.push_back(it->path());
+            }
+        }
+        for (const fs::path& file : stale) {
+            fs::remove(file, error);
+        }
+    }
+
+    // Split "keys" into chunks, write them as the base and make it current
+    bool writeBaseFile(const std::vector<T>& keys, uint64_t id) {
+        size_t count = std::max<size_t>(1, (keys.size() + chunkKeys - 1) / chunkKeys);
+        std::vector<T> newFences(count);
+        std::vector<CheckpointChunk> table(count);
+        uint64_t offset = sizeof(CheckpointFileHeader) + count * sizeof(CheckpointChunk);
+        for (size_t i = 0; i < count; i++) {
+            size_t first = std::min(keys.size(), i * chunkKeys);
+            size_t last = std::min(keys.size(), first + chunkKeys);
+            if (i > 0) {
+                newFences[i] = keys[first];
+            }
+            table[i].index = i;
+            table[i].keyCount = last - first;
+            table[i].offset = offset + first * sizeof(T);
+        }
+
+        std::string name = baseName();
+        std::FILE* out = std::fopen((name + ".tmp").c_str(), "wb");
+        if (!out) {
+            return false;
+        }
+        CheckpointFileHeader header = makeHeader(CheckpointKind::Base, id, 0, count, count);
+        bool ok = std::fwrite(&header, sizeof(header), 1, out) == 1
+                  && writeAll(out, table.data(), count)
+                  && writeAll(out, keys.data(), keys.size())
+                  && writeAll(out, newFences.data(), count);
+        ok = std::fclose(out) == 0 && ok;
+        if (!ok || std::rename((name + ".tmp").c_str(), name.c_str()) != 0) {
+            return false;
+        }
+        baseId = id;
+        fences = std::move(newFences);
+        dirty.assign(fences.size(), 0);
+        nextSequence = 1;
+        return true;
+    }
+
+    template <typename U>
+    static bool writeAll(std::FILE* out, const U* data, size_t count) {
+        return count == 0 || std::fwrite(data, sizeof(U), count, out) == count;
+    }
+
+    static bool readHeader(std::FILE* in, CheckpointFileHeader& header) {
+        return std::fread(&header, sizeof(header), 1, in) == 1
+               && std::memcmp(header.magic, "AVLCKPT", 8) == 0
+               && header.version == kCheckpointVersion
+               && header.keySize == sizeof(T);
+    }
+
+    // Open the base and every delta of its chain, and find the newest
+    // copy of each chunk. Deltas of another base end the chain.
+    bool openChain(Chain& chain) const {
+        std::FILE* base = std::fopen(baseName().c_str(), "rb");
+        if (!base) {
+            return false;
+        }
+        chain.files.push_back(base);
+        CheckpointFileHeader header;
+        if (!readHeader(base, header) || header.kind != (uint32_t)CheckpointKind::Base) {
+            closeChain(chain);
+            return false;
+        }
+        chain.baseId = header.baseId;
+        uint64_t baseSize = fileSize(base);
+        if (!tableFits(header, baseSize)) {
+            closeChain(chain);
+            return false;
+        }
+        std::vector<CheckpointChunk> table(header.chunkCount);
+        uint64_t keyCount = 0;
+        bool ok = std::fread(table.data(), sizeof(CheckpointChunk), table.size(), base) == table.size();
+        for (const CheckpointChunk& chunk : table) {
+            ok = ok && chunkFits(chunk, header, baseSize);
+            keyCount += chunk.keyCount;
+        }
+        chain.fences.resize(header.chunkCount);
+        ok = ok && std::fseek(base, (long)(sizeof(header) + table.size() * sizeof(CheckpointChunk)
+                                           + keyCount * sizeof(T)), SEEK_SET) == 0
+                && std::fread(chain.fences.data(), sizeof(T), chain.fences.size(), base)
+                   == chain.fences.size();
+        if (!ok) {
+            closeChain(chain);
+            return false;
+        }
+        for (const CheckpointChunk& chunk : table) {
+            chain.latest.push_back(std::make_pair((size_t)0, chunk));
+        }
+
+        // A delta torn by a crash may have a sound header and table but
+        // miss keys; it ends the chain like a missing one
+        for (uint64_t s = 1;; s++) {
+            std::FILE* delta = std::fopen(deltaName(s).c_str(), "rb");
+            if (!delta) {
+                break;
+            }
+            uint64_t deltaSize = fileSize(delta);
+            CheckpointFileHeader dh;
+            if (!readHeader(delta, dh) || dh.kind != (uint32_t)CheckpointKind::Delta
+                || dh.baseId != chain.baseId || dh.sequence != s || !tableFits(dh, deltaSize)) {
+                std::fclose(delta);
+                break;
+            }
+            std::vector<CheckpointChunk> entries(dh.chunkCount);
+            bool whole = std::fread(entries.data(), sizeof(CheckpointChunk), entries.size(), delta)
+                         == entries.size();
+            for (const CheckpointChunk& chunk : entries) {
+                whole = whole && chunkFits(chunk, dh, deltaSize);
+            }
+            if (!whole) {
+                std::fclose(delta);
+                break;
+            }
+            chain.files.push_back(delta);
+            for (const CheckpointChunk& chunk : entries) {
+                if (chunk.index < chain.latest.size()) {
+                    chain.latest[chunk.index] = std::make_pair(chain.files.size() - 1, chunk);
+                }
+            }
+        }
+        return true;
+    }
+
+    static uint64_t fileSize(std::FILE* file) {
+        long here = std::ftell(file);
+        if (here < 0 || std::fseek(file, 0, SEEK_END) != 0) {
+            return 0;
+        }
+        long end = std::ftell(file);
+        std::fseek(file, here, SEEK_SET);
+        return end < 0 ? 0 : (uint64_t)end;
+    }
+
+    // The chunk table of "header" fits in a file of "size" bytes
+    static bool tableFits(const CheckpointFileHeader& header, uint64_t size) {
+        return size >= sizeof(header)
+               && header.chunkCount <= (size - sizeof(header)) / sizeof(CheckpointChunk);
+    }
+
+    // The keys of "chunk" lie after the table and inside the file
+    static bool chunkFits(const CheckpointChunk& chunk, const CheckpointFileHeader& header,
+                          uint64_t size) {
+        uint64_t keysStart = sizeof(header) + header.chunkCount * sizeof(CheckpointChunk);
+        return chunk.offset >= keysStart && chunk.offset <= size
+               && chunk.keyCount <= (size - chunk.offset) / sizeof(T);
+    }
+
+    static void closeChain(Chain& chain) {
+        for (std::FILE* file : chain.files) {
+            std::fclose(file);
+        }
+        chain.files.clear();
+    }
+
+    // Pass every chunk's keys to "sink" in key order, a block at a time
+    template <typename Sink>
+    static bool streamChain(Chain& chain, Sink sink) {
+        std::vector<T> buffer(4096);
+        for (const auto& entry : chain.latest) {
+            std::FILE* in = chain.files[entry.first];
+            const CheckpointChunk& chunk = entry.second;
+            if (std::fseek(in, (long)chunk.offset, SEEK_SET) != 0) {
+                return false;
+            }
+            for (uint64_t left = chunk.keyCount; left > 0;) {
+                size_t n = (size_t)std::min<uint64_t>(left, buffer.size());
+                if (std::fread(buffer.data(), sizeof(T), n, in) != n) {
+                    return false;
+                }
+                sink(buffer.data(), n);
+                left -= n;
+            }
+        }
+        return true;
+    }
+};
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,614 @@
+#ifndef CONCURRENT_TREE_H
+#define CONCURRENT_TREE_H
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "AVLTree.h"
+
+// ----------------------------------------------------
+// Optimistic version lock
+//   One word per node: bit 0 = obsolete (the node was replaced by a
+//   rebuild), bit 1 = write-locked, the rest a counter bumped by every
+//   unlock. A reader remembers the word, reads the node, and checks
+//   that the word has not changed since; it never writes to shared
+//   memory and never waits. A writer turns a version it has read into
+//   a lock with one compare-and-swap, which fails if anything changed
+//   in between.
+// ----------------------------------------------------
+class OptimisticLock {
+public:
+    // Version to validate against later; false if locked or obsolete
+    bool readLock(uint64_t& version) const {
+        version = word.load(std::memory_order_acquire);
+        return (version & 3) == 0;
+    }
+
+    // True if nothing was written since readLock returned "version"
+    bool validate(uint64_t version) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return word.load(std::memory_order_relaxed) == version;
+    }
+
+    bool upgrade(uint64_t version) {
+        return word.compare_exchange_strong(version, version + 2, std::memory_order_acquire);
+    }
+
+    // Wait for the lock; false if the node is (or becomes) obsolete
+    bool lock() {
+        for (;;) {
+            uint64_t version = word.load(std::memory_order_relaxed);
+            if (version & 1) {
+                return false;
+            }
+            if (version & 2) {
+                std::this_thread::yield(); // the holder may be descheduled
+            } else if (word.compare_exchange_weak(version, version + 2,
+                                                  std::memory_order_acquire)) {
+                return true;
+            }
+        }
+    }
+
+    void unlock() {
+        word.fetch_add(2, std::memory_order_release);
+    }
+
+    void unlockObsolete() {
+        word.fetch_add(3, std::memory_order_release);
+    }
+
+private:
+    std::atomic<uint64_t> word{0};
+};
+
+// Wait a little before retrying after a failed validation: a few CPU
+// pause hints first, then give the core to the thread being waited
+// for, which may be descheduled
+inline void retryBackoff(unsigned& attempt) {
+    if (attempt < 6) {
+        for (unsigned i = 0; i < (1u << attempt); i++) {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        }
+    } else {
+        std::this_thread::yield();
+    }
+    attempt++;
+}
+
+// ----------------------------------------------------
+// Concurrent relaxed-shape tree
+//   A node tree for many writers at once, with optimistic lock
+//   coupling: every operation walks down reading versions and takes
+//   no lock until it writes. Insert locks only the node it hangs the
+//   new leaf from; remove and re-insert lock only the key's node (a
+//   removed key stays as a dead separator, as with tombstones in
+//   AVLTree). Writers in disjoint key ranges therefore never touch
+//   the same lock, and readers never block anybody.
+//
+//   The shape is relaxed instead of rebuilt on every write: a leaf
+//   may sit up to log base 3/2 of the node count deep. An insert
+//   below that walks back up its path to the lowest ancestor whose
+//   subtree is badly skewed (one child holding more than 2/3 of it,
+//   as in a scapegoat tree) and rebuilds that subtree alone into the
+//   upper-middle shape. The rebuild locks the parent and then every
+//   node of the subtree, top-down, drops the dead keys, swaps the new
+//   subtree in, and marks the old nodes obsolete so that readers
+//   inside them start over. Once more keys are dead than alive the
+//   whole tree is rebuilt the same way.
+//
+//   Replaced nodes may still be read by threads that have not yet
+//   noticed, so they are retired rather than freed. Every operation
+//   counts itself in one of a few per-thread-striped counters, under
+//   the current of two phases. Once the retired nodes outnumber half
+//   the tree (and at least kReclaimMin), the writer that retired them
+//   flips the phase after its operation, waits for the operations of
+//   the old phase to finish, and frees what was retired before the
+//   flip. collectGarbage() frees everything at once, but only while
+//   no other thread uses the tree.
+// ----------------------------------------------------
+template <typename T, typename Compare = std::less<T>>
+class ConcurrentAVLTree {
+public:
+    explicit ConcurrentAVLTree(const Compare& comp = Compare())
+        : root(nullptr), comp(comp), nodeCount(0), liveCount(0)
+    {}
+
+    ConcurrentAVLTree(const ConcurrentAVLTree&) = delete;
+    ConcurrentAVLTree& operator=(const ConcurrentAVLTree&) = delete;
+
+    ~ConcurrentAVLTree() {
+        std::vector<Node*> nodes;
+        collect(root.load(std::memory_order_relaxed), nodes);
+        for (Node* node : nodes) {
+            delete node;
+        }
+        collectGarbage();
+    }
+
+    void insert(const T& key) {
+        {
+            Node* spare = nullptr;
+            OperationGuard guard(*this);
+            unsigned attempt = 0;
+            while (tryInsert(key, spare) < 0) {
+                retryBackoff(attempt);
+            }
+            delete spare;
+        }
+        reclaimIfDue();
+    }
+
+    void remove(const T& key) {
+        {
+            OperationGuard guard(*this);
+            unsigned attempt = 0;
+            while (tryRemove(key) < 0) {
+                retryBackoff(attempt);
+            }
+            if (deadCount() > liveCount.load(std::memory_order_relaxed)) {
+                rebuild(&rootLock, &root, root.load(std::memory_order_acquire));
+            }
+        }
+        reclaimIfDue();
+    }
+
+    bool search(const T& key) const {
+        OperationGuard guard(*this);
+        unsigned attempt = 0;
+        for (;;) {
+            int found = trySearch(key);
+            if (found >= 0) {
+                return found == 1;
+            }
+            retryBackoff(attempt);
+        }
+    }
+
+    // Live keys
+    size_t size() const {
+        return liveCount.load(std::memory_order_relaxed);
+    }
+
+    // Free the nodes replaced by rebuilds. Only while no other thread
+    // uses the tree.
+    void collectGarbage() {
+        std::lock_guard<std::mutex> guard(retiredMutex);
+        for (Node* node : retired) {
+            delete node;
+        }
+        retired.clear();
+    }
+
+    // Replaced nodes not yet freed
+    size_t retiredNodes() {
+        std::lock_guard<std::mutex> guard(retiredMutex);
+        return retired.size();
+    }
+
+    // The live keys in order (only while no other thread writes)
+    std::vector<T> getSortedElements() const {
+        std::vector<Node*> nodes;
+        collect(root.load(std::memory_order_acquire), nodes);
+        std::vector<T> keys;
+        for (Node* node : nodes) {
+            if (node->live.load(std::memory_order_relaxed)) {
+                keys.push_back(node->key);
+            }
+        }
+        return keys;
+    }
+
+    // Levels of the tree, dead separators included (only while no
+    // other thread writes)
+    int height() const {
+        struct Pending {
+            Node* node;
+            int depth;
+        };
+        std::vector<Pending> stack;
+        int deepest = 0;
+        if (Node* top = root.load(std::memory_order_acquire)) {
+            stack.push_back({top, 1});
+        }
+        while (!stack.empty()) {
+            Pending p = stack.back();
+            stack.pop_back();
+            deepest = std::max(deepest, p.depth);
+            if (Node* l = p.node->left.load(std::memory_order_acquire)) {
+                stack.push_back({l, p.depth + 1});
+            }
+            if (Node* r = p.node->right.load(std::memory_order_acquire)) {
+                stack.push_back({r, p.depth + 1});
+            }
+        }
+        return deepest;
+    }
+
+private:
+    struct Node {
+        const T key;
+        std::atomic<Node*> left;
+        std::atomic<Node*> right;
+        std::atomic<bool> live;
+        OptimisticLock lock;
+
+        explicit Node(const T& k) : key(k), left(nullptr), right(nullptr), live(true) {}
+    };
+
+    // One step of an insert's path: the node, the lock that guards the
+    // link to it (its parent's, or rootLock) and that link
+    struct Step {
+        Node* node;
+        OptimisticLock* parentLock;
+        std::atomic<Node*>* link;
+    };
+    static const int kMaxPath = 128;
+    static constexpr size_t kReclaimMin = 1024;
+    static constexpr size_t kStripes = 16;
+
+    // Operations in progress that started in phase 0 or 1, one cache
+    // line per stripe
+    struct alignas(64) Stripe {
+        std::atomic<size_t> active[2] = {};
+    };
+
+    // Counts the calling thread's operation in the current phase
+    class OperationGuard {
+    public:
+        explicit OperationGuard(const ConcurrentAVLTree& tree)
+            : counter(nullptr)
+        {
+            Stripe& stripe = tree.stripes[stripeIndex()];
+            unsigned p = tree.phase.load(std::memory_order_acquire);
+            counter = &stripe.active[p];
+            counter->fetch_add(1, std::memory_order_seq_cst);
+        }
+        ~OperationGuard() {
+            counter->fetch_sub(1, std::memory_order_release);
+        }
+        OperationGuard(const OperationGuard&) = delete;
+        OperationGuard& operator=(const OperationGuard&) = delete;
+
+    private:
+        std::atomic<size_t>* counter;
+
+        static size_t stripeIndex() {
+            static thread_local const size_t index =
+                std::hash<std::thread::id>()(std::this_thread::get_id()) % kStripes;
+            return index;
+        }
+    };
+
+    std::atomic<Node*> root;
+    mutable OptimisticLock rootLock;    // Guards "root" like a parent node
+    Compare comp;
+    std::atomic<size_t> nodeCount;      // Nodes in the tree, dead ones included
+    std::atomic<size_t> liveCount;
+    std::mutex retiredMutex;
+    std::vector<Node*> retired;
+    mutable Stripe stripes[kStripes];
+    std::atomic<unsigned> phase{0};
+    std::mutex reclaimMutex;             // One reclaimer at a time
+
+    bool same(const T& a, const T& b) const {
+        return !comp(a, b) && !comp(b, a);
+    }
+
+    // Counters change under the lock of the node they count, so two
+    // loads may see different moments; never report less than none
+    size_t deadCount() const {
+        size_t live = liveCount.load(std::memory_order_relaxed);
+        size_t nodes = nodeCount.load(std::memory_order_relaxed);
+        return nodes > live ? nodes - live : 0;
+    }
+
+    // Deepest depth (root = 0) a new leaf may have
+    static int depthLimit(size_t nodes) {
+        return (int)(std::log((double)nodes + 1) / std::log(1.5)) + 1;
+    }
+
+    // 1 = present, 0 = absent, -1 = a version changed: start over
+    int trySearch(const T& key) const {
+        const OptimisticLock* parentLock = &rootLock;
+        uint64_t parentVersion;
+        if (!parentLock->readLock(parentVersion)) {
+            return -1;
+        }
+        Node* node = root.load(std::memory_order_acquire);
+        while (node) {
+            uint64_t version;
+            if (!node->lock.readLock(version) || !parentLock->validate(parentVersion)) {
+                return -1;
+            }
+            if (same(key, node->key)) {
+                bool live = node->live.load(std::memory_order_relaxed);
+                return node->lock.validate(version) ? live : -1;
+            }
+            Node* next = (comp(key, node->key) ? node->left : node->right)
+                             .load(std::memory_order_acquire);
+            parentLock = &node->lock;
+            parentVersion = version;
+            node = next;
+        }
+        return parentLock->validate(parentVersion) ? 0 : -1;
+    }
+
+    // 1 = inserted, 0 = already present, -1 = start over. "spare" is
+    // the new leaf, allocated once outside any lock and reused across
+    // retries.
+    int tryInsert(const T& key, Node*& spare) {
+        Step path[kMaxPath];
+        int depth = 0;
+        OptimisticLock* parentLock = &rootLock;
+        std::atomic<Node*>* link = &root;
+        uint64_t parentVersion;
+        if (!parentLock->readLock(parentVersion)) {
+            return -1;
+        }
+        Node* node = link->load(std::memory_order_acquire);
+        while (node) {
+            uint64_t version;
+            if (!node->lock.readLock(version) || !parentLock->validate(parentVersion)) {
+                return -1;
+            }
+            if (same(key, node->key)) {
+                if (node->live.load(std::memory_order_relaxed)) {
+                    return node->lock.validate(version) ? 0 : -1;
+                }
+                if (!node->lock.upgrade(version)) {
+                    return -1;
+                }
+                node->live.store(true, std::memory_order_relaxed);
+                liveCount.fetch_add(1, std::memory_order_relaxed);
+                node->lock.unlock();
+                return 1;
+            }
+            if (depth < kMaxPath) {
+                path[depth] = {node, parentLock, link};
+            }
+            depth++;
+            parentLock = &node->lock;
+            parentVersion = version;
+            link = comp(key, node->key) ? &node->left : &node->right;
+            node = link->load(std::memory_order_acquire);
+        }
+
+        if (!spare) {
+            spare = new Node(key);
+        }
+        if (!parentLock->upgrade(parentVersion)) {
+            return -1;
+        }
+        Node* leaf = spare;
+        spare = nullptr;
+        link->store(leaf, std::memory_order_release);
+        size_t nodes = nodeCount.fetch_add(1, std::memory_order_relaxed) + 1;
+        liveCount.fetch_add(1, std::memory_order_relaxed);
+        parentLock->unlock();
+
+        if (depth > depthLimit(nodes)) {
+            if (depth > kMaxPath) {
+                rebuild(&rootLock, &root, root.load(std::memory_order_acquire));
+            } else {
+                rebalance(path, depth, leaf);
+            }
+        }
+        return 1;
+    }
+
+    // 1 = removed, 0 = absent, -1 = start over
+    int tryRemove(const T& key) {
+        const OptimisticLock* parentLock = &rootLock;
+        uint64_t parentVersion;
+        if (!parentLock->readLock(parentVersion)) {
+            return -1;
+        }
+        Node* node = root.load(std::memory_order_acquire);
+        while (node) {
+            uint64_t version;
+            if (!node->lock.readLock(version) || !parentLock->validate(parentVersion)) {
+                return -1;
+            }
+            if (same(key, node->key)) {
+                if (!node->live.load(std::memory_order_relaxed)) {
+                    return node->lock.validate(version) ? 0 : -1;
+                }
+                if (!node->lock.upgrade(version)) {
+                    return -1;
+                }
+                node->live.store(false, std::memory_order_relaxed);
+                liveCount.fetch_sub(1, std::memory_order_relaxed);
+                node->lock.unlock();
+                return 1;
+            }
+            Node* next = (comp(key, node->key) ? node->left : node->right)
+                             .load(std::memory_order_acquire);
+            parentLock = &node->lock;
+            parentVersion = version;
+            node = next;
+        }
+        return parentLock->validate(parentVersion) ? 0 : -1;
+    }
+
+    // Find the scapegoat on the path to a too-deep "leaf": the lowest
+    // ancestor with a child holding more than 2/3 of its subtree. The
+    // sizes are counted without locks, so under concurrent writes they
+    // are estimates; the rebuild itself runs under locks.
+    void rebalance(Step* path, int depth, Node* leaf) {
+        size_t size = 1;
+        Node* child = leaf;
+        for (int i = depth - 1; i >= 0; i--) {
+            Node* node = path[i].node;
+            Node* left = node->left.load(std::memory_order_acquire);
+            Node* other = left == child ? node->right.load(std::memory_order_acquire) : left;
+            size_t total = 1 + size + countNodes(other);
+            if (size * 3 > total * 2) {
+                rebuild(path[i].parentLock, path[i].link, node);
+                return;
+            }
+            size = total;
+            child = node;
+        }
+    }
+
+    size_t countNodes(Node* top) const {
+        std::vector<Node*> stack;
+        size_t count = 0;
+        if (top) {
+            stack.push_back(top);
+        }
+        while (!stack.empty()) {
+            Node* node = stack.back();
+            stack.pop_back();
+            count++;
+            if (Node* l = node->left.load(std::memory_order_acquire)) {
+                stack.push_back(l);
+            }
+            if (Node* r = node->right.load(std::memory_order_acquire)) {
+                stack.push_back(r);
+            }
+        }
+        return count;
+    }
+
+    // Replace the subtree at "top" (reached through "link", guarded by
+    // "parentLock") with an upper-middle tree of its live keys. Locks
+    // are taken top-down only, and other writers hold one lock at a
+    // time, so two rebuilds never wait on each other in a cycle.
+    // Gives up if the subtree was already replaced.
+    void rebuild(OptimisticLock* parentLock, std::atomic<Node*>* link, Node* top) {
+        if (!parentLock->lock()) {
+            return;
+        }
+        if (!top || link->load(std::memory_order_relaxed) != top) {
+            parentLock->unlock();
+            return;
+        }
+
+        // In-order walk that locks each node before reading its links
+        std::vector<Node*> old;
+        std::vector<T> keys;
+        std::vector<Node*> stack;
+        Node* node = top;
+        while (node || !stack.empty()) {
+            while (node) {
+                // Nodes go obsolete only under their parent's lock, which
+                // is held, so this cannot fail; if it ever does, back out
+                // rather than rebuild a subtree that is already gone
+                if (!node->lock.lock()) {
+                    for (Node* held : old) {
+                        held->lock.unlock();
+                    }
+                    for (Node* held : stack) {
+                        held->lock.unlock();
+                    }
+                    parentLock->unlock();
+                    return;
+                }
+                stack.push_back(node);
+                node = node->left.load(std::memory_order_relaxed);
+            }
+            node = stack.back();
+            stack.pop_back();
+            old.push_back(node);
+            if (node->live.load(std::memory_order_relaxed)) {
+                keys.push_back(node->key);
+            }
+            node = node->right.load(std::memory_order_relaxed);
+        }
+
+        link->store(buildUpperMiddle(keys), std::memory_order_release);
+        for (Node* gone : old) {
+            gone->lock.unlockObsolete();
+        }
+        nodeCount.fetch_sub(old.size() - keys.size(), std::memory_order_relaxed);
+        parentLock->unlock();
+
+        std::lock_guard<std::mutex> guard(retiredMutex);
+        retired.insert(retired.end(), old.begin(), old.end());
+    }
+
+    // Free the retired nodes once there are too many. Runs outside any
+    // operation of the calling thread, which would otherwise wait for
+    // itself. Nodes retired before the flip are unreachable to every
+    // operation that starts after it, so once the old phase drains
+    // nobody can still hold one.
+    void reclaimIfDue() {
+        {
+            std::lock_guard<std::mutex> guard(retiredMutex);
+            size_t limit = std::max(kReclaimMin, nodeCount.load(std::memory_order_relaxed) / 2);
+            if (retired.size() < limit) {
+                return;
+            }
+        }
+        std::unique_lock<std::mutex> reclaiming(reclaimMutex, std::try_to_lock);
+        if (!reclaiming.owns_lock()) {
+            return;
+        }
+        std::vector<Node*> batch;
+        {
+            std::lock_guard<std::mutex> guard(retiredMutex);
+            batch.swap(retired);
+        }
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        unsigned old = phase.fetch_xor(1, std::memory_order_seq_cst);
+        for (Stripe& stripe : stripes) {
+            while (stripe.active[old].load(std::memory_order_seq_cst) != 0) {
+                std::this_thread::yield();
+            }
+        }
+        for (Node* node : batch) {
+            delete node;
+        }
+    }
+
+    // Fresh, unshared nodes; published by the caller's release store
+    Node* buildUpperMiddle(const std::vector<T>& keys) {
+        struct Pending {
+            long lo;
+            long hi;
+            std::atomic<Node*>* link;
+        };
+        std::atomic<Node*> top(nullptr);
+        std::vector<Pending> stack{{0, (long)keys.size() - 1, &top}};
+        while (!stack.empty()) {
+            Pending p = stack.back();
+            stack.pop_back();
+            if (p.lo > p.hi) {
+                continue;
+            }
+            long mid = avl_build::middle(p.lo, p.hi);
+            Node* node = new Node(keys[mid]);
+            p.link->store(node, std::memory_order_relaxed);
+            stack.push_back({mid + 1, p.hi, &node->right});
+            stack.push_back({p.lo, mid - 1, &node->left});
+        }
+        return top.load(std::memory_order_relaxed);
+    }
+
+    // Every node below "top", in order
+    void collect(Node* top, std::vector<Node*>& out) const {
+        std::vector<Node*> stack;
+        Node* node = top;
+        while (node || !stack.empty()) {
+            while (node) {
+                stack.push_back(node);
+                node = node->left.load(std::memory_order_acquire);
+            }
+            node = stack.back();
+            stack.pop_back();
+            out.push_back(node);
+            node = node->right.load(std::memory_order_acquire);
+        }
+    }
+};
+
+#endif // CONCURRENT_TREE_H
@@ -0,0 +1,253 @@
+#ifndef ELIAS_FANO_H
+#define ELIAS_FANO_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+#include "AVLTree.h"
+
+// ----------------------------------------------------
+// Elias-Fano encoding of a strictly increasing sequence
+//   Each value is split into "lowBits" low bits, stored packed, and
+//   the remaining high part, stored in unary in a bit vector (element
+//   i sets bit high(x_i) + i). That takes about 2 + log2(U/n) bits per
+//   key. select(i) finds the i-th set bit of the high part through a
+//   sampled position of every kSampleRate-th one and then a short
+//   popcount scan, so it runs in constant time on average.
+// ----------------------------------------------------
+class EliasFano {
+public:
+    static const size_t kSampleRate = 256;
+
+    EliasFano() : n(0), lowBits(0) {}
+
+    // "sorted" must be strictly increasing
+    explicit EliasFano(const std::vector<uint64_t>& sorted)
+        : n(sorted.size()), lowBits(0)
+    {
+        if (n == 0) {
+            return;
+        }
+        // lowBits = floor(log2(U / n)); the largest value stands in for
+        // U so that a key of 2^64 - 1 cannot overflow
+        uint64_t largest = sorted.back();
+        while (lowBits < 63 && (largest >> (lowBits + 1)) >= n) {
+            lowBits++;
+        }
+
+        low.assign((n * lowBits + 63) / 64 + 1, 0);
+        size_t highSize = n + (size_t)(sorted.back() >> lowBits) + 1;
+        high.assign((highSize + 63) / 64, 0);
+        samples.reserve(n / kSampleRate + 1);
+
+        uint64_t lowMask = lowBits == 0 ? 0 : (~0ULL >> (64 - lowBits));
+        for (size_t i = 0; i < n; i++) {
+            uint64_t x = sorted[i];
+            setLow(i, x & lowMask);
+            size_t pos = (size_t)(x >> lowBits) + i;
+            high[pos / 64] |= 1ULL << (pos % 64);
+            if (i % kSampleRate == 0) {
+                samples.push_back(pos);
+            }
+        }
+    }
+
+    size_t size() const {
+        return n;
+    }
+
+    // The i-th smallest value
+    uint64_t select(size_t i) const {
+        return ((uint64_t)(selectHigh(i) - i) << lowBits) | getLow(i);
+    }
+
+    // All values in order, in one pass over the bit vectors
+    std::vector<uint64_t> decode() const {
+        std::vector<uint64_t> out;
+        out.reserve(n);
+        for (size_t w = 0; w < high.size() && out.size() < n; w++) {
+            uint64_t bits = high[w];
+            while (bits) {
+                size_t pos = w * 64 + (size_t)__builtin_ctzll(bits);
+                size_t i = out.size();
+                out.push_back(((uint64_t)(pos - i) << lowBits) | getLow(i));
+                bits &= bits - 1;
+            }
+        }
+        return out;
+    }
+
+    size_t sizeInBytes() const {
+        return low.size() * sizeof(uint64_t)
+             + high.size() * sizeof(uint64_t)
+             + samples.size() * sizeof(size_t);
+    }
+
+private:
+    size_t n;
+    unsigned lowBits;
+    std::vector<uint64_t> low;     // n packed lowBits-wide fields
+    std::vector<uint64_t> high;    // unary-coded high parts
+    std::vector<size_t> samples;   // high-part bit of elements 0, 256, 512, ...
+
+    void setLow(size_t i, uint64_t value) {
+        if (lowBits == 0) {
+            return;
+        }
+        size_t bit = i * lowBits;
+        low[bit / 64] |= value << (bit % 64);
+        if (bit % 64 + lowBits > 64) {
+            low[bit / 64 + 1] |= value >> (64 - bit % 64);
+        }
+    }
+
+    uint64_t getLow(size_t i) const {
+        if (lowBits == 0) {
+            return 0;
+        }
+        size_t bit = i * lowBits;
+        uint64_t value = low[bit / 64] >> (bit % 64);
+        if (bit % 64 + lowBits > 64) {
+            value |= low[bit / 64 + 1] << (64 - bit % 64);
+        }
+        return value & (~0ULL >> (64 - lowBits));
+    }
+
+    // Position of the k-th (0-based) set bit of "word"
+    static unsigned selectInWord(uint64_t word, unsigned k) {
+#ifdef __BMI2__
+        return (unsigned)__builtin_ctzll(_pdep_u64(1ULL << k, word));
+#else
+        for (unsigned j = 0; j < k; j++) {
+            word &= word - 1;
+        }
+        return (unsigned)__builtin_ctzll(word);
+#endif
+    }
+
+    // Position of the i-th set bit of the high part
+    size_t selectHigh(size_t i) const {
+        size_t pos = samples[i / kSampleRate];
+        size_t remaining = i % kSampleRate;
+        size_t w = pos / 64;
+        // Ones in the first word from "pos" onwards (inclusive)
+        uint64_t bits = high[w] & (~0ULL << (pos % 64));
+        for (;;) {
+            size_t ones = (size_t)__builtin_popcountll(bits);
+            if (remaining < ones) {
+                return w * 64 + selectInWord(bits, (unsigned)remaining);
+            }
+            remaining -= ones;
+            bits = high[++w];
+        }
+    }
+};
+
+// ----------------------------------------------------
+// Succinct "Special AVL" Tree over unsigned integer IDs
+//   Same interface and search paths as AVLTree<uint64_t>, but the keys
+//   are kept Elias-Fano encoded and the upper-middle tree is never
+//   materialized: search walks it virtually by rank, reading each
+//   node's key with select(). Writes re-encode, just as AVLTree
+//   rebuilds its nodes on every write.
+// ----------------------------------------------------
+class SuccinctAVLTree {
+private:
+    EliasFano keys;
+
+    void reencode(const std::vector<uint64_t>& sorted) {
+        keys = EliasFano(sorted);
+    }
+
+public:
+    SuccinctAVLTree() {}
+
+    // Copies the keys a search of "tree" finds, including writes still
+    // in an incremental rebuild's delta and without tombstoned keys
+    template <typename Storage, typename Layout, typename Rebuild>
+    explicit SuccinctAVLTree(const AVLTree<uint64_t, Storage, Layout, Rebuild>& tree)
+        : keys(tree.liveKeys())
+    {}
+
+    void insert(uint64_t key) {
+        std::vector<uint64_t> sorted = keys.decode();
+        auto it = std::lower_bound(sorted.begin(), sorted.end(), key);
+        if (it == sorted.end() || *it != key) {
+            sorted.insert(it, key);
+            reencode(sorted);
+        }
+    }
+
+    void remove(uint64_t key) {
+        std::vector<uint64_t> sorted = keys.decode();
+        auto it = std::lower_bound(sorted.begin(), sorted.end(), key);
+        if (it != sorted.end() && *it == key) {
+            sorted.erase(it);
+            reencode(sorted);
+        }
+    }
+
+    // Replace the contents with the given IDs (any order, duplicates allowed)
+    void bulkLoad(std::vector<uint64_t> ids) {
+        std::sort(ids.begin(), ids.end());
+        ids.resize(set_kernels::uniqueSorted(ids.data(), ids.size()));
+        reencode(ids);
+    }
+
+    // Binary search over ranks: the node for [lo, hi] is rank
+    // (lo + hi + 1) / 2, exactly as in buildBalancedTree
+    bool search(uint64_t key) const {
+        long lo = 0;
+        long hi = (long)keys.size() - 1;
+        while (lo <= hi) {
+            long mid = (lo + hi + 1) / 2; // "upper" middle
+            uint64_t value = keys.select((size_t)mid);
+            if (value == key) {
+                return true;
+            }
+            if (key < value) {
+                hi = mid - 1;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        return false;
+    }
+
+    // Keys of the nodes visited while searching for "key", root first
+    std::vector<uint64_t> getSearchPath(uint64_t key) const {
+        std::vector<uint64_t> path;
+        long lo = 0;
+        long hi = (long)keys.size() - 1;
+        while (lo <= hi) {
+            long mid = (lo + hi + 1) / 2;
+            uint64_t value = keys.select((size_t)mid);
+            path.push_back(value);
+            if (value == key) {
+                break;
+            }
+            if (key < value) {
+                hi = mid - 1;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        return path;
+    }
+
+    size_t size() const {
+        return keys.size();
+    }
+
+    // Bits of storage per key, including the select samples
+    double bitsPerKey() const {
+        return keys.size() == 0 ? 0.0 : 8.0 * keys.sizeInBytes() / keys.size();
+    }
+};
+
+#endif // ELIAS_FANO_H
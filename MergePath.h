@@ -0,0 +1,144 @@
+#ifndef MERGE_PATH_H
+#define MERGE_PATH_H
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#include "SetKernels.h"
+
+// ----------------------------------------------------
+// Merge-path partitioning
+//   The merge of a[0..na) and b[0..nb) writes its outputs along a
+//   path through the na x nb grid. Output diagonal d crosses that path
+//   at exactly one point (i, d - i), found by a binary search over i,
+//   so the merge splits into T pieces of equal output length without
+//   looking at the keys in between. Every piece is merged on its own
+//   thread. Ties put a's key first.
+//
+//   The set kernels below take sorted, duplicate-free inputs and run
+//   the kernels of SetKernels.h on each piece. Their output is
+//   shorter than na + nb, so every piece first counts its output, and
+//   then all pieces write to their final offsets in the destination
+//   at once.
+// ----------------------------------------------------
+
+// Number of a's keys among the first "diag" outputs of the merge
+template <typename T, typename Compare>
+size_t mergePathSplit(const T* a, size_t na, const T* b, size_t nb, size_t diag,
+                      Compare comp)
+{
+    size_t lo = diag > nb ? diag - nb : 0;
+    size_t hi = std::min(diag, na);
+    // Smallest i whose a[i] comes after b[diag - i - 1]
+    while (lo < hi) {
+        size_t i = lo + (hi - lo) / 2;
+        if (comp(b[diag - i - 1], a[i])) {
+            hi = i;
+        } else {
+            lo = i + 1;
+        }
+    }
+    return lo;
+}
+
+// Run fn(0) .. fn(threads - 1), fn(0) on the calling thread
+template <typename Fn>
+void runOnThreads(unsigned threads, Fn fn) {
+    std::vector<std::thread> workers;
+    for (unsigned t = 1; t < threads; t++) {
+        workers.emplace_back(fn, t);
+    }
+    fn(0u);
+    for (std::thread& w : workers) {
+        w.join();
+    }
+}
+
+// Pieces smaller than this are not worth a thread
+const size_t kMergePathMinPiece = 1 << 16;
+
+// Threads actually used for "work" items: 0 asks for one per core
+inline unsigned mergePathThreads(unsigned threads, size_t work) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    size_t useful = std::max<size_t>(1, work / kMergePathMinPiece);
+    return (unsigned)std::min<size_t>(threads, useful);
+}
+
+// Apply a set kernel piece by piece: count(a, na, b, nb) gives the
+// length of a piece's result and write(a, na, b, nb, out, room)
+// writes it. "out" must have room for the result, whose length is
+// returned.
+template <typename T, typename Compare, typename Count, typename Write>
+size_t mergePathApply(const T* a, size_t na, const T* b, size_t nb, T* out, size_t room,
+                      unsigned threads, Compare comp, Count count, Write write)
+{
+    threads = mergePathThreads(threads, na + nb);
+    if (threads <= 1) {
+        return write(a, na, b, nb, out, room);
+    }
+
+    // Piece t covers a[ai[t]..ai[t+1]) and b[bi[t]..bi[t+1]). A key in
+    // both inputs could be cut off from its twin (a's copy ends one
+    // piece, b's starts the next), so b's copy moves to a's piece.
+    std::vector<size_t> ai(threads + 1), bi(threads + 1);
+    ai[threads] = na;
+    bi[threads] = nb;
+    for (unsigned t = 1; t < threads; t++) {
+        size_t diag = (na + nb) * t / threads;
+        ai[t] = mergePathSplit(a, na, b, nb, diag, comp);
+        bi[t] = diag - ai[t];
+        if (ai[t] > 0 && bi[t] < nb && !comp(a[ai[t] - 1], b[bi[t]])) {
+            bi[t]++;
+        }
+    }
+
+    std::vector<size_t> offset(threads + 1, 0);
+    runOnThreads(threads, [&](unsigned t) {
+        offset[t + 1] = count(a + ai[t], ai[t + 1] - ai[t], b + bi[t], bi[t + 1] - bi[t]);
+    });
+    for (unsigned t = 0; t < threads; t++) {
+        offset[t + 1] += offset[t];
+    }
+    // Each piece may only write its own share of "out"
+    runOnThreads(threads, [&](unsigned t) {
+        write(a + ai[t], ai[t + 1] - ai[t], b + bi[t], bi[t + 1] - bi[t], out + offset[t],
+              offset[t + 1] - offset[t]);
+    });
+    return offset[threads];
+}
+
+// out = a | b; "out" must have room for na + nb keys
+template <typename T, typename Compare>
+size_t parallelSetUnion(const T* a, size_t na, const T* b, size_t nb, T* out,
+                        unsigned threads, Compare comp)
+{
+    return mergePathApply(
+        a, na, b, nb, out, na + nb, threads, comp,
+        [comp](const T* x, size_t nx, const T* y, size_t ny) {
+            return nx + ny - set_kernels::intersectionSize(x, nx, y, ny, comp);
+        },
+        [comp](const T* x, size_t nx, const T* y, size_t ny, T* dst, size_t room) {
+            return set_kernels::setUnion(x, nx, y, ny, dst, room, comp);
+        });
+}
+
+// out = a - b; "out" must have room for na keys
+template <typename T, typename Compare>
+size_t parallelSetDifference(const T* a, size_t na, const T* b, size_t nb, T* out,
+                             unsigned threads, Compare comp)
+{
+    return mergePathApply(
+        a, na, b, nb, out, na, threads, comp,
+        [comp](const T* x, size_t nx, const T* y, size_t ny) {
+            return nx - set_kernels::intersectionSize(x, nx, y, ny, comp);
+        },
+        [comp](const T* x, size_t nx, const T* y, size_t ny, T* dst, size_t room) {
+            return set_kernels::setDifference(x, nx, y, ny, dst, room, comp);
+        });
+}
+
+#endif // MERGE_PATH_H
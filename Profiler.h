@@ -0,0 +1,55 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <chrono>
+#include <cstdint>
+
+// ----------------------------------------------------
+// Lightweight scoped timers
+//   A ProfileStat accumulates the time of every ScopedTimer that
+//   points at it. endFrame() moves the running total into frameNs so
+//   per-frame figures can be shown while the next frame is measured.
+// ----------------------------------------------------
+struct ProfileStat {
+    uint64_t lastNs = 0;     // duration of the most recent scope
+    uint64_t runningNs = 0;  // accumulated since the last endFrame()
+    uint64_t frameNs = 0;    // total of the previous frame
+    uint64_t totalNs = 0;    // since creation
+    uint64_t calls = 0;
+
+    void add(uint64_t ns) {
+        lastNs = ns;
+        runningNs += ns;
+        totalNs += ns;
+        calls++;
+    }
+
+    void endFrame() {
+        frameNs = runningNs;
+        runningNs = 0;
+    }
+
+    double lastMs() const { return lastNs / 1e6; }
+    double frameMs() const { return frameNs / 1e6; }
+};
+
+class ScopedTimer {
+public:
+    explicit ScopedTimer(ProfileStat& s)
+        : stat(s), start(std::chrono::steady_clock::now())
+    {}
+
+    ~ScopedTimer() {
+        stat.add((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    ProfileStat& stat;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif // PROFILER_H
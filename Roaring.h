@@ -0,0 +1,527 @@
+#ifndef ROARING_H
+#define ROARING_H
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "SetKernels.h"
+
+// ----------------------------------------------------
+// Roaring container
+//   Holds the low 16 bits of every key that shares the same high 16
+//   bits, in one of three forms:
+//     - Array:  sorted values, used up to kArrayMax keys
+//     - Bitmap: 65536 bits, used above that
+//     - Run:    (start, length - 1) pairs, chosen by runOptimize()
+//   Writes to a run container expand it back to array/bitmap first.
+// ----------------------------------------------------
+class RoaringContainer {
+public:
+    enum Kind : uint8_t { Array, Bitmap, Run };
+
+    static const uint32_t kArrayMax = 4096;
+    static const uint32_t kBitmapWords = 1024;
+
+    RoaringContainer() : kind(Array), cardinality(0) {}
+
+    Kind type() const { return kind; }
+    uint32_t size() const { return cardinality; }
+
+    bool contains(uint16_t v) const {
+        switch (kind) {
+        case Array:
+            return std::binary_search(array.begin(), array.end(), v);
+        case Bitmap:
+            return (bitmap[v >> 6] >> (v & 63)) & 1;
+        case Run: {
+            auto it = runAfter(v);
+            if (it == runs.begin()) return false;
+            --it;
+            return v <= (uint32_t)it->first + it->second;
+        }
+        }
+        return false;
+    }
+
+    // Returns true if "v" was not present
+    bool add(uint16_t v) {
+        expandRuns();
+        if (kind == Array) {
+            auto it = std::lower_bound(array.begin(), array.end(), v);
+            if (it != array.end() && *it == v) return false;
+            if (cardinality == kArrayMax) {
+                toBitmap();
+                return add(v);
+            }
+            array.insert(it, v);
+        } else {
+            uint64_t& word = bitmap[v >> 6];
+            uint64_t bit = 1ULL << (v & 63);
+            if (word & bit) return false;
+            word |= bit;
+        }
+        cardinality++;
+        return true;
+    }
+
+    // Returns true if "v" was present
+    bool erase(uint16_t v) {
+        expandRuns();
+        if (kind == Array) {
+            auto it = std::lower_bound(array.begin(), array.end(), v);
+            if (it == array.end() || *it != v) return false;
+            array.erase(it);
+        } else {
+            uint64_t& word = bitmap[v >> 6];
+            uint64_t bit = 1ULL << (v & 63);
+            if (!(word & bit)) return false;
+            word &= ~bit;
+        }
+        cardinality--;
+        if (kind == Bitmap && cardinality <= kArrayMax) {
+            toArray();
+        }
+        return true;
+    }
+
+    // Number of values below "v" (v may be 65536)
+    uint32_t rankBelow(uint32_t v) const {
+        switch (kind) {
+        case Array:
+            return (uint32_t)(std::lower_bound(array.begin(), array.end(), v) - array.begin());
+        case Bitmap: {
+            uint32_t count = 0;
+            uint32_t words = v >> 6;
+            for (uint32_t w = 0; w < words; w++) {
+                count += (uint32_t)__builtin_popcountll(bitmap[w]);
+            }
+            if ((v & 63) && words < kBitmapWords) {
+                count += (uint32_t)__builtin_popcountll(bitmap[words] & ((1ULL << (v & 63)) - 1));
+            }
+            return count;
+        }
+        case Run: {
+            uint32_t count = 0;
+            for (const auto& r : runs) {
+                uint32_t start = r.first;
+                uint32_t end = start + r.second; // inclusive
+                if (v <= start) break;
+                count += std::min(v - 1, end) - start + 1;
+            }
+            return count;
+        }
+        }
+        return 0;
+    }
+
+    // The i-th smallest value (i < size())
+    uint16_t select(uint32_t i) const {
+        switch (kind) {
+        case Array:
+            return array[i];
+        case Bitmap:
+            for (uint32_t w = 0; w < kBitmapWords; w++) {
+                uint32_t ones = (uint32_t)__builtin_popcountll(bitmap[w]);
+                if (i < ones) {
+                    uint64_t bits = bitmap[w];
+                    for (uint32_t j = 0; j < i; j++) {
+                        bits &= bits - 1;
+                    }
+                    return (uint16_t)(w * 64 + __builtin_ctzll(bits));
+                }
+                i -= ones;
+            }
+            break;
+        case Run:
+            for (const auto& r : runs) {
+                if (i <= r.second) {
+                    return (uint16_t)(r.first + i);
+                }
+                i -= r.second + 1u;
+            }
+            break;
+        }
+        return 0;
+    }
+
+    // Switch to run encoding when it is the smallest of the three
+    void runOptimize() {
+        if (kind == Run || cardinality == 0) return;
+        std::vector<std::pair<uint16_t, uint16_t>> found;
+        forEach([&](uint16_t v) {
+            if (!found.empty() && (uint32_t)found.back().first + found.back().second + 1 == v) {
+                found.back().second++;
+            } else {
+                found.push_back(std::make_pair(v, (uint16_t)0));
+            }
+        });
+        size_t runBytes = found.size() * 4;
+        size_t currentBytes = (kind == Array) ? cardinality * 2 : kBitmapWords * 8;
+        if (runBytes < currentBytes) {
+            runs.swap(found);
+            array.clear();
+            array.shrink_to_fit();
+            bitmap.clear();
+            bitmap.shrink_to_fit();
+            kind = Run;
+        }
+    }
+
+    template <typename Fn>
+    void forEach(Fn fn) const {
+        switch (kind) {
+        case Array:
+            for (uint16_t v : array) fn(v);
+            break;
+        case Bitmap:
+            for (uint32_t w = 0; w < kBitmapWords; w++) {
+                uint64_t bits = bitmap[w];
+                while (bits) {
+                    fn((uint16_t)(w * 64 + __builtin_ctzll(bits)));
+                    bits &= bits - 1;
+                }
+            }
+            break;
+        case Run:
+            for (const auto& r : runs) {
+                for (uint32_t v = r.first; v <= (uint32_t)r.first + r.second; v++) {
+                    fn((uint16_t)v);
+                }
+            }
+            break;
+        }
+    }
+
+    size_t sizeInBytes() const {
+        return array.capacity() * sizeof(uint16_t)
+             + bitmap.capacity() * sizeof(uint64_t)
+             + runs.capacity() * sizeof(runs[0]);
+    }
+
+    // ----------------------------------------------------
+    // Set algebra
+    // ----------------------------------------------------
+    static RoaringContainer unite(const RoaringContainer& a, const RoaringContainer& b) {
+        RoaringContainer out;
+        if (a.kind == Bitmap && b.kind == Bitmap) {
+            out.bitmap.resize(kBitmapWords);
+            out.cardinality = bitmapOp(a.bitmap.data(), b.bitmap.data(), out.bitmap.data(), false);
+            out.kind = Bitmap;
+        } else if (a.kind == Array && b.kind == Array && a.cardinality + b.cardinality <= kArrayMax) {
+            std::set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                           std::back_inserter(out.array));
+            out.cardinality = (uint32_t)out.array.size();
+        } else {
+            out = a;
+            out.expandRuns();
+            out.toBitmap();
+            b.forEach([&](uint16_t v) {
+                uint64_t bit = 1ULL << (v & 63);
+                if (!(out.bitmap[v >> 6] & bit)) {
+                    out.bitmap[v >> 6] |= bit;
+                    out.cardinality++;
+                }
+            });
+        }
+        out.normalize();
+        return out;
+    }
+
+    static RoaringContainer intersect(const RoaringContainer& a, const RoaringContainer& b) {
+        RoaringContainer out;
+        if (a.kind == Bitmap && b.kind == Bitmap) {
+            out.bitmap.resize(kBitmapWords);
+            out.cardinality = bitmapOp(a.bitmap.data(), b.bitmap.data(), out.bitmap.data(), true);
+            out.kind = Bitmap;
+        } else {
+            // Walk the smaller side and probe the other one
+            const RoaringContainer& small = (a.cardinality <= b.cardinality) ? a : b;
+            const RoaringContainer& large = (&small == &a) ? b : a;
+            small.forEach([&](uint16_t v) {
+                if (large.contains(v)) out.array.push_back(v);
+            });
+            out.cardinality = (uint32_t)out.array.size();
+        }
+        out.normalize();
+        return out;
+    }
+
+private:
+    Kind kind;
+    uint32_t cardinality;
+    std::vector<uint16_t> array;
+    std::vector<uint64_t> bitmap;
+    std::vector<std::pair<uint16_t, uint16_t>> runs;
+
+    // First run starting after "v"
+    std::vector<std::pair<uint16_t, uint16_t>>::const_iterator runAfter(uint16_t v) const {
+        return std::upper_bound(runs.begin(), runs.end(), v,
+                                [](uint16_t x, const std::pair<uint16_t, uint16_t>& r) {
+                                    return x < r.first;
+                                });
+    }
+
+    void toBitmap() {
+        if (kind == Bitmap) return;
+        bitmap.assign(kBitmapWords, 0);
+        for (uint16_t v : array) {
+            bitmap[v >> 6] |= 1ULL << (v & 63);
+        }
+        array.clear();
+        array.shrink_to_fit();
+        kind = Bitmap;
+    }
+
+    void toArray() {
+        if (kind == Array) return;
+        std::vector<uint16_t> values;
+        values.reserve(cardinality);
+        forEach([&](uint16_t v) { values.push_back(v); });
+        array.swap(values);
+        bitmap.clear();
+        bitmap.shrink_to_fit();
+        kind = Array;
+    }
+
+    void expandRuns() {
+        if (kind != Run) return;
+        std::vector<std::pair<uint16_t, uint16_t>> old;
+        old.swap(runs);
+        kind = Array;
+        if (cardinality > kArrayMax) {
+            bitmap.assign(kBitmapWords, 0);
+            kind = Bitmap;
+        }
+        for (const auto& r : old) {
+            for (uint32_t v = r.first; v <= (uint32_t)r.first + r.second; v++) {
+                if (kind == Array) {
+                    array.push_back((uint16_t)v);
+                } else {
+                    bitmap[v >> 6] |= 1ULL << (v & 63);
+                }
+            }
+        }
+    }
+
+    // Pick array or bitmap form from the cardinality
+    void normalize() {
+        if (kind == Bitmap && cardinality <= kArrayMax) {
+            toArray();
+        } else if (kind == Array && cardinality > kArrayMax) {
+            toBitmap();
+        }
+    }
+
+    // out = a | b (or a & b); returns the popcount of the result. The
+    // AVX2 loop is compiled for AVX2 (and POPCNT, which every AVX2 CPU
+    // has) whatever the build flags, and only taken when the CPU has
+    // it (see set_kernels::hasAvx2).
+    static uint32_t bitmapOp(const uint64_t* a, const uint64_t* b, uint64_t* out, bool intersect) {
+#ifdef SET_KERNELS_X86
+        if (set_kernels::hasAvx2()) {
+            return bitmapOpAvx2(a, b, out, intersect);
+        }
+#endif
+        uint32_t count = 0;
+        for (uint32_t w = 0; w < kBitmapWords; w++) {
+            out[w] = intersect ? (a[w] & b[w]) : (a[w] | b[w]);
+            count += (uint32_t)__builtin_popcountll(out[w]);
+        }
+        return count;
+    }
+
+#ifdef SET_KERNELS_X86
+    __attribute__((target("avx2,popcnt")))
+    static uint32_t bitmapOpAvx2(const uint64_t* a, const uint64_t* b, uint64_t* out, bool intersect) {
+        static_assert(kBitmapWords % 4 == 0, "whole vectors only");
+        uint32_t count = 0;
+        for (uint32_t w = 0; w < kBitmapWords; w += 4) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + w));
+            __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + w));
+            __m256i r = intersect ? _mm256_and_si256(x, y) : _mm256_or_si256(x, y);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + w), r);
+            count += (uint32_t)(__builtin_popcountll(out[w]) + __builtin_popcountll(out[w + 1])
+                              + __builtin_popcountll(out[w + 2]) + __builtin_popcountll(out[w + 3]));
+        }
+        return count;
+    }
+#endif
+};
+
+// ----------------------------------------------------
+// Roaring "Special AVL" Tree over 32-bit keys
+//   For dense integer keys: the keys live in roaring containers and
+//   insert/remove only touch one container, so nothing is rebuilt.
+//   The upper-middle tree stays virtual: search walks it by rank with
+//   select(), giving the same paths as AVLTree<uint32_t>.
+// ----------------------------------------------------
+class RoaringAVLTree {
+private:
+    std::vector<uint16_t> highKeys;            // sorted high 16 bits
+    std::vector<RoaringContainer> containers;  // one per high key
+    mutable std::vector<uint64_t> prefix;      // keys before container i
+    mutable bool prefixValid = false;
+
+    static uint16_t highOf(uint32_t key) { return (uint16_t)(key >> 16); }
+    static uint16_t lowOf(uint32_t key) { return (uint16_t)(key & 0xFFFF); }
+
+    size_t findContainer(uint16_t high) const {
+        return std::lower_bound(highKeys.begin(), highKeys.end(), high) - highKeys.begin();
+    }
+
+    void updatePrefix() const {
+        if (prefixValid) return;
+        prefix.resize(containers.size() + 1);
+        prefix[0] = 0;
+        for (size_t i = 0; i < containers.size(); i++) {
+            prefix[i + 1] = prefix[i] + containers[i].size();
+        }
+        prefixValid = true;
+    }
+
+public:
+    void insert(uint32_t key) {
+        size_t i = findContainer(highOf(key));
+        if (i == highKeys.size() || highKeys[i] != highOf(key)) {
+            highKeys.insert(highKeys.begin() + i, highOf(key));
+            containers.insert(containers.begin() + i, RoaringContainer());
+        }
+        if (containers[i].add(lowOf(key))) {
+            prefixValid = false;
+        }
+    }
+
+    void remove(uint32_t key) {
+        size_t i = findContainer(highOf(key));
+        if (i == highKeys.size() || highKeys[i] != highOf(key)) {
+            return;
+        }
+        if (containers[i].erase(lowOf(key))) {
+            prefixValid = false;
+            if (containers[i].size() == 0) {
+                highKeys.erase(highKeys.begin() + i);
+                containers.erase(containers.begin() + i);
+            }
+        }
+    }
+
+    // Direct membership test (same answer as the tree walk below)
+    bool contains(uint32_t key) const {
+        size_t i = findContainer(highOf(key));
+        return i < highKeys.size() && highKeys[i] == highOf(key)
+               && containers[i].contains(lowOf(key));
+    }
+
+    // Same answer as walking the upper-middle tree (getSearchPath),
+    // but taken straight from the container
+    bool search(uint32_t key) const {
+        return contains(key);
+    }
+
+    // Keys of the nodes visited while searching for "key", root first
+    std::vector<uint32_t> getSearchPath(uint32_t key) const {
+        std::vector<uint32_t> path;
+        long lo = 0;
+        long hi = (long)size() - 1;
+        while (lo <= hi) {
+            long mid = (lo + hi + 1) / 2; // "upper" middle
+            uint32_t value = select((uint64_t)mid);
+            path.push_back(value);
+            if (value == key) {
+                break;
+            }
+            if (key < value) {
+                hi = mid - 1;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        return path;
+    }
+
+    uint64_t size() const {
+        updatePrefix();
+        return prefix.back();
+    }
+
+    // Number of keys below "key"
+    uint64_t rank(uint32_t key) const {
+        updatePrefix();
+        size_t i = findContainer(highOf(key));
+        uint64_t count = prefix[i];
+        if (i < highKeys.size() && highKeys[i] == highOf(key)) {
+            count += containers[i].rankBelow(lowOf(key));
+        }
+        return count;
+    }
+
+    // The i-th smallest key (i < size())
+    uint32_t select(uint64_t i) const {
+        updatePrefix();
+        size_t c = std::upper_bound(prefix.begin(), prefix.end(), i) - prefix.begin() - 1;
+        return ((uint32_t)highKeys[c] << 16) | containers[c].select((uint32_t)(i - prefix[c]));
+    }
+
+    // Number of keys in [lo, hi)
+    uint64_t countRange(uint32_t lo, uint32_t hi) const {
+        return hi <= lo ? 0 : rank(hi) - rank(lo);
+    }
+
+    // Convert containers to run form where that is smaller
+    void runOptimize() {
+        for (auto& c : containers) {
+            c.runOptimize();
+        }
+    }
+
+    void unionWith(const RoaringAVLTree& other) {
+        RoaringAVLTree out;
+        size_t i = 0, j = 0;
+        while (i < highKeys.size() || j < other.highKeys.size()) {
+            if (j == other.highKeys.size() || (i < highKeys.size() && highKeys[i] < other.highKeys[j])) {
+                out.highKeys.push_back(highKeys[i]);
+                out.containers.push_back(containers[i++]);
+            } else if (i == highKeys.size() || other.highKeys[j] < highKeys[i]) {
+                out.highKeys.push_back(other.highKeys[j]);
+                out.containers.push_back(other.containers[j++]);
+            } else {
+                out.highKeys.push_back(highKeys[i]);
+                out.containers.push_back(RoaringContainer::unite(containers[i++], other.containers[j++]));
+            }
+        }
+        *this = std::move(out);
+    }
+
+    void intersectWith(const RoaringAVLTree& other) {
+        RoaringAVLTree out;
+        size_t i = 0, j = 0;
+        while (i < highKeys.size() && j < other.highKeys.size()) {
+            if (highKeys[i] < other.highKeys[j]) {
+                i++;
+            } else if (other.highKeys[j] < highKeys[i]) {
+                j++;
+            } else {
+                RoaringContainer c = RoaringContainer::intersect(containers[i++], other.containers[j++]);
+                if (c.size() > 0) {
+                    out.highKeys.push_back(highKeys[i - 1]);
+                    out.containers.push_back(std::move(c));
+                }
+            }
+        }
+        *this = std::move(out);
+    }
+
+    size_t sizeInBytes() const {
+        size_t bytes = highKeys.capacity() * sizeof(uint16_t)
+                     + containers.capacity() * sizeof(RoaringContainer);
+        for (const auto& c : containers) {
+            bytes += c.sizeInBytes();
+        }
+        return bytes;
+    }
+};
+
+#endif // ROARING_H
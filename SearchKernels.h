@@ -0,0 +1,351 @@
+#ifndef SEARCH_KERNELS_H
+#define SEARCH_KERNELS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SEARCH_KERNELS_X86 1
+#endif
+
+#include "BinarySearch.h"
+
+// ----------------------------------------------------
+// Search kernels
+//   Alternative ways to answer "is this key present?" over the same
+//   sorted keys. Which one is fastest depends on the tree size, the
+//   caches and the instruction set, so AVLTree::autotune() measures
+//   them on the machine it runs on.
+//     Pointer    - walk the AVLNode tree (the default)
+//     Eytzinger  - keys of a complete tree in heap order, branchless
+//                  descent with prefetching four levels ahead
+//     Branchless - prefetchSearch over the sorted keys themselves
+//     KAry       - 17-ary search tree of 16-key blocks; each block is
+//                  ranked with one SIMD compare
+//     BPlusTree  - pointer-free B+ tree: the sorted keys are the leaves
+//                  and each upper level holds the largest key of every
+//                  16-key block below it
+// ----------------------------------------------------
+enum class SearchKernel { Pointer, Eytzinger, Branchless, KAry, BPlusTree };
+
+const int kSearchKernelCount = 5;
+
+inline const char* kernelName(SearchKernel kernel) {
+    switch (kernel) {
+    case SearchKernel::Pointer:    return "pointer";
+    case SearchKernel::Eytzinger:  return "eytzinger";
+    case SearchKernel::Branchless: return "branchless";
+    case SearchKernel::KAry:       return "k-ary";
+    case SearchKernel::BPlusTree:  return "b+tree";
+    }
+    return "?";
+}
+
+// ----------------------------------------------------
+// Cache sizes and instruction set of the machine we run on
+// ----------------------------------------------------
+struct CpuInfo {
+    size_t l1Bytes;
+    size_t l2Bytes;
+    size_t l3Bytes;
+    bool avx2;
+    bool avx512;
+    bool bmi2;
+
+    static CpuInfo detect() {
+        CpuInfo info;
+        info.l1Bytes = cacheSize(_SC_LEVEL1_DCACHE_SIZE, 32 << 10);
+        info.l2Bytes = cacheSize(_SC_LEVEL2_CACHE_SIZE, 1 << 20);
+        info.l3Bytes = cacheSize(_SC_LEVEL3_CACHE_SIZE, 8 << 20);
+#ifdef SEARCH_KERNELS_X86
+        info.avx2 = __builtin_cpu_supports("avx2");
+        info.avx512 = __builtin_cpu_supports("avx512f");
+        info.bmi2 = __builtin_cpu_supports("bmi2");
+#else
+        info.avx2 = info.avx512 = info.bmi2 = false;
+#endif
+        return info;
+    }
+
+private:
+    // sysconf reports 0 or -1 where the size is unknown (VMs, non-x86)
+    static size_t cacheSize(int name, size_t fallback) {
+        long bytes = sysconf(name);
+        return bytes > 0 ? (size_t)bytes : fallback;
+    }
+};
+
+namespace search_kernels {
+
+const int kBlock = 16; // keys per k-ary / B+ tree block
+
+// Number of keys in block[0..15] that are less than x
+template <typename T, typename Compare>
+int countLessScalar(const T* block, const T& x, const Compare& comp) {
+    int count = 0;
+    for (int i = 0; i < kBlock; i++) {
+        count += comp(block[i], x) ? 1 : 0;
+    }
+    return count;
+}
+
+#ifdef SEARCH_KERNELS_X86
+// Compiled for AVX2 even when the rest of the program is not, and
+// only called after CpuInfo says the CPU has it
+__attribute__((target("avx2")))
+inline int countLessAvx2(const int32_t* block, int32_t x) {
+    __m256i v = _mm256_set1_epi32(x);
+    __m256i lo = _mm256_loadu_si256((const __m256i*)block);
+    __m256i hi = _mm256_loadu_si256((const __m256i*)(block + 8));
+    int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(v, lo)))
+             | _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(v, hi))) << 8;
+    return __builtin_popcount((unsigned)mask);
+}
+
+__attribute__((target("avx2")))
+inline int countLessAvx2(const int64_t* block, int64_t x) {
+    __m256i v = _mm256_set1_epi64x(x);
+    int mask = 0;
+    for (int i = 0; i < 4; i++) {
+        __m256i keys = _mm256_loadu_si256((const __m256i*)(block + 4 * i));
+        mask |= _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(v, keys))) << (4 * i);
+    }
+    return __builtin_popcount((unsigned)mask);
+}
+#endif
+
+// SIMD ranking for signed 32/64-bit keys under std::less
+template <typename T, typename Compare>
+int countLess(const T* block, const T& x, const Compare& comp, bool avx2) {
+#ifdef SEARCH_KERNELS_X86
+    if constexpr (std::is_integral<T>::value && std::is_signed<T>::value &&
+                  (sizeof(T) == 4 || sizeof(T) == 8) &&
+                  std::is_same<Compare, std::less<T>>::value) {
+        if (avx2) {
+            typedef typename std::conditional<sizeof(T) == 4, int32_t, int64_t>::type Lane;
+            return countLessAvx2((const Lane*)block, (Lane)x);
+        }
+    }
+#endif
+    (void)avx2;
+    return countLessScalar(block, x, comp);
+}
+
+} // namespace search_kernels
+
+// ----------------------------------------------------
+// Read-only search structure for one kernel, built from the sorted
+// keys. The KAry and BPlusTree kernels pad blocks with the largest
+// value of T, so they need arithmetic keys ordered by std::less.
+// ----------------------------------------------------
+template <typename T, typename Compare = std::less<T>>
+class SearchIndex {
+public:
+    static bool supports(SearchKernel kernel) {
+        if (kernel == SearchKernel::KAry || kernel == SearchKernel::BPlusTree) {
+            return std::is_arithmetic<T>::value && std::is_same<Compare, std::less<T>>::value;
+        }
+        return true;
+    }
+
+    SearchIndex(const std::vector<T>& sorted, SearchKernel kernel, bool avx2,
+                Compare comp = Compare())
+        : kernel(kernel), avx2(avx2), comp(comp), n(sorted.size())
+    {
+        switch (kernel) {
+        case SearchKernel::Eytzinger:
+            buildEytzinger(sorted);
+            break;
+        case SearchKernel::KAry:
+            buildKAry(sorted);
+            break;
+        case SearchKernel::BPlusTree:
+            buildBPlusTree(sorted);
+            break;
+        default:
+            break; // Pointer and Branchless need nothing beyond the keys
+        }
+    }
+
+    // "sorted" must be the keys the index was built from (Branchless
+    // searches them directly; the largest value of T falls back to it)
+    bool contains(const std::vector<T>& sorted, const T& key) const {
+        switch (kernel) {
+        case SearchKernel::Eytzinger:
+            return searchEytzinger(key);
+        case SearchKernel::KAry:
+            return isPadding(key) ? binaryContains(sorted, key) : searchKAry(key);
+        case SearchKernel::BPlusTree:
+            return isPadding(key) ? binaryContains(sorted, key) : searchBPlusTree(key);
+        default:
+            return prefetchSearch(sorted.begin(), sorted.end(), key, comp) != -1;
+        }
+    }
+
+    SearchKernel getKernel() const {
+        return kernel;
+    }
+
+    size_t sizeInBytes() const {
+        size_t bytes = (eytzinger.size() + kary.size()) * sizeof(T);
+        for (const auto& level : levels) {
+            bytes += level.size() * sizeof(T);
+        }
+        return bytes;
+    }
+
+private:
+    SearchKernel kernel;
+    bool avx2;
+    Compare comp;
+    size_t n;
+    std::vector<T> eytzinger;             // 1-based heap order
+    std::vector<T> kary;                  // blocks of kBlock keys
+    std::vector<std::vector<T>> levels;   // B+ tree, leaves first
+
+    static T padding() {
+        if constexpr (std::is_arithmetic<T>::value) {
+            return std::numeric_limits<T>::max();
+        } else {
+            return T();
+        }
+    }
+
+    bool isPadding(const T& key) const {
+        if constexpr (std::is_arithmetic<T>::value) {
+            return key == padding();
+        } else {
+            return false;
+        }
+    }
+
+    bool binaryContains(const std::vector<T>& sorted, const T& key) const {
+        return std::binary_search(sorted.begin(), sorted.end(), key, comp);
+    }
+
+    // In-order walk of the complete tree assigns the sorted keys
+    void fillEytzinger(const std::vector<T>& sorted, size_t& next, size_t k) {
+        if (k <= n) {
+            fillEytzinger(sorted, next, 2 * k);
+            eytzinger[k] = sorted[next++];
+            fillEytzinger(sorted, next, 2 * k + 1);
+        }
+    }
+
+    void buildEytzinger(const std::vector<T>& sorted) {
+        eytzinger.resize(n + 1);
+        size_t next = 0;
+        fillEytzinger(sorted, next, 1);
+    }
+
+    bool searchEytzinger(const T& key) const {
+        const T* keys = eytzinger.data();
+        size_t k = 1;
+        while (k <= n) {
+            // The 16 descendants four levels down share a cache line
+            // or two, so this hides the latency of the next steps
+            __builtin_prefetch(keys + std::min(16 * k, n));
+            k = 2 * k + (comp(keys[k], key) ? 1 : 0);
+        }
+        // Undo the right turns after the last left turn: that node is
+        // the lower bound
+        k >>= __builtin_ffsll((long long)~k);
+        return k != 0 && !comp(key, keys[k]);
+    }
+
+    static size_t karyChild(size_t block, int i) {
+        return block * (search_kernels::kBlock + 1) + i + 1;
+    }
+
+    void fillKAry(const std::vector<T>& sorted, size_t& next, size_t block, size_t blocks) {
+        if (block >= blocks) {
+            return;
+        }
+        for (int i = 0; i < search_kernels::kBlock; i++) {
+            fillKAry(sorted, next, karyChild(block, i), blocks);
+            kary[block * search_kernels::kBlock + i] = next < n ? sorted[next++] : padding();
+        }
+        fillKAry(sorted, next, karyChild(block, search_kernels::kBlock), blocks);
+    }
+
+    void buildKAry(const std::vector<T>& sorted) {
+        size_t blocks = (n + search_kernels::kBlock - 1) / search_kernels::kBlock;
+        kary.assign(blocks * search_kernels::kBlock, padding());
+        size_t next = 0;
+        fillKAry(sorted, next, 0, blocks);
+    }
+
+    bool searchKAry(const T& key) const {
+        size_t blocks = kary.size() / search_kernels::kBlock;
+        const T* lowerBound = nullptr;
+        size_t block = 0;
+        while (block < blocks) {
+            const T* keys = kary.data() + block * search_kernels::kBlock;
+            int i = search_kernels::countLess(keys, key, comp, avx2);
+            if (i < search_kernels::kBlock) {
+                lowerBound = keys + i;
+            }
+            block = karyChild(block, i);
+        }
+        return lowerBound != nullptr && !comp(key, *lowerBound);
+    }
+
+    void buildBPlusTree(const std::vector<T>& sorted) {
+        auto padded = [](std::vector<T>& level) {
+            size_t rem = level.size() % search_kernels::kBlock;
+            if (rem != 0 || level.empty()) {
+                level.resize(level.size() + search_kernels::kBlock - rem, padding());
+            }
+        };
+        levels.push_back(sorted);
+        padded(levels.back());
+        while (levels.back().size() > (size_t)search_kernels::kBlock) {
+            const std::vector<T>& below = levels.back();
+            std::vector<T> level;
+            level.reserve(below.size() / search_kernels::kBlock + search_kernels::kBlock);
+            for (size_t i = search_kernels::kBlock - 1; i < below.size(); i += search_kernels::kBlock) {
+                level.push_back(below[i]);
+            }
+            padded(level);
+            levels.push_back(std::move(level));
+        }
+    }
+
+    bool searchBPlusTree(const T& key) const {
+        size_t index = 0;
+        for (size_t l = levels.size(); l-- > 0;) {
+            // A key above every real key lands on the padding of an
+            // upper level, which points one block past the level below
+            // when that level ends on a block boundary
+            if (index * search_kernels::kBlock >= levels[l].size()) {
+                return false;
+            }
+            const T* keys = levels[l].data() + index * search_kernels::kBlock;
+            int r = search_kernels::countLess(keys, key, comp, avx2);
+            if (r == search_kernels::kBlock) {
+                return false; // Greater than every key (only at the top)
+            }
+            index = index * search_kernels::kBlock + r;
+        }
+        return index < n && !comp(key, levels[0][index]);
+    }
+};
+
+// ----------------------------------------------------
+// Outcome of AVLTree::autotune()
+// ----------------------------------------------------
+struct AutotuneReport {
+    SearchKernel chosen;
+    double nsPerSearch[kSearchKernelCount]; // by kernel; < 0 if not available
+    size_t sampleKeys;                      // keys the kernels were measured on
+    CpuInfo cpu;
+};
+
+#endif // SEARCH_KERNELS_H
@@ -0,0 +1,494 @@
+#ifndef SET_KERNELS_H
+#define SET_KERNELS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SET_KERNELS_X86 1
+#endif
+
+// ----------------------------------------------------
+// Set kernels
+//   The linear passes behind every batched write, over sorted keys:
+//     uniqueSorted       - drop repeats from a sorted run, in place
+//     setUnion           - merge two duplicate-free runs into one
+//     setDifference      - keys of one run missing from the other
+//     intersectionSize   - how many keys two runs share
+//   For 32- and 64-bit integers under std::less there are AVX2
+//   versions, picked at run time when the CPU has AVX2:
+//     merge   - bitonic network that merges one vector of each run
+//               per step (8 or 4 keys); repeats are dropped on the
+//               way out
+//     dedup   - compare a vector with itself shifted by one lane and
+//               pack the survivors with one permute, looked up in a
+//               table by the comparison mask
+//     compare - all pairs of one vector of each run, by rotating one
+//               of them; differences are packed the same way
+//   Merges need signed keys (AVX2 has no unsigned 64-bit compare);
+//   the other kernels only test equality and take either. Everything
+//   else runs the scalar std:: algorithms.
+// ----------------------------------------------------
+
+namespace set_kernels {
+
+// Output iterator that only counts what is written to it
+struct CountingOutput {
+    typedef std::output_iterator_tag iterator_category;
+    typedef void value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef void pointer;
+    typedef void reference;
+
+    size_t n = 0;
+    CountingOutput& operator*() { return *this; }
+    CountingOutput& operator++() { n++; return *this; }
+    CountingOutput operator++(int) { CountingOutput c = *this; n++; return c; }
+    template <typename U>
+    CountingOutput& operator=(const U&) { return *this; }
+};
+
+// Which kernels have an AVX2 version for T under Compare
+template <typename T, typename Compare>
+struct Simd {
+    static const bool kEqual =
+#ifdef SET_KERNELS_X86
+        std::is_integral<T>::value && (sizeof(T) == 4 || sizeof(T) == 8) &&
+        std::is_same<Compare, std::less<T>>::value;
+#else
+        false;
+#endif
+    static const bool kMerge = kEqual && std::is_signed<T>::value;
+};
+
+inline bool hasAvx2() {
+#ifdef SET_KERNELS_X86
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+#else
+    return false;
+#endif
+}
+
+#ifdef SET_KERNELS_X86
+namespace detail {
+
+// Permutation indices (32-bit lanes) that move the lanes set in a
+// mask to the front: one entry per mask of 8 lanes of 4 bytes, or of
+// 4 lanes of 8 bytes (two 32-bit halves each)
+struct PackTable {
+    alignas(32) int32_t lanes32[256][8];
+    alignas(32) int32_t lanes64[16][8];
+
+    PackTable() {
+        for (int mask = 0; mask < 256; mask++) {
+            int k = 0;
+            for (int lane = 0; lane < 8; lane++) {
+                if (mask >> lane & 1) {
+                    lanes32[mask][k++] = lane;
+                }
+            }
+            while (k < 8) {
+                lanes32[mask][k++] = 0;
+            }
+        }
+        for (int mask = 0; mask < 16; mask++) {
+            int k = 0;
+            for (int lane = 0; lane < 4; lane++) {
+                if (mask >> lane & 1) {
+                    lanes64[mask][k++] = 2 * lane;
+                    lanes64[mask][k++] = 2 * lane + 1;
+                }
+            }
+            while (k < 8) {
+                lanes64[mask][k++] = 0;
+            }
+        }
+    }
+};
+
+inline const PackTable& packTable() {
+    static const PackTable table;
+    return table;
+}
+
+// Vector operations on 4- or 8-byte lanes
+template <size_t Bytes>
+struct Lanes;
+
+template <>
+struct Lanes<4> {
+    static const int W = 8;
+
+    __attribute__((target("avx2")))
+    static __m256i min(__m256i a, __m256i b) { return _mm256_min_epi32(a, b); }
+
+    __attribute__((target("avx2")))
+    static __m256i max(__m256i a, __m256i b) { return _mm256_max_epi32(a, b); }
+
+    __attribute__((target("avx2")))
+    static __m256i reverse(__m256i v) {
+        return _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+    }
+
+    // Sort a bitonic vector: compare-exchange at distance 4, 2, 1
+    __attribute__((target("avx2")))
+    static __m256i clean(__m256i v) {
+        __m256i t = _mm256_permute2x128_si256(v, v, 1);
+        v = _mm256_blend_epi32(min(v, t), max(v, t), 0xF0);
+        t = _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+        v = _mm256_blend_epi32(min(v, t), max(v, t), 0xCC);
+        t = _mm256_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1));
+        return _mm256_blend_epi32(min(v, t), max(v, t), 0xAA);
+    }
+
+    __attribute__((target("avx2")))
+    static int equal(__m256i a, __m256i b) {
+        return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b)));
+    }
+
+    // Lane i takes lane i + 1 (the last takes the first)
+    __attribute__((target("avx2")))
+    static __m256i rotate(__m256i v) {
+        return _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0));
+    }
+
+    // Lane i takes lane i - 1, the first takes "prev"
+    __attribute__((target("avx2")))
+    static __m256i shiftIn(__m256i v, int64_t prev) {
+        __m256i shifted = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6));
+        return _mm256_blend_epi32(shifted, _mm256_set1_epi32((int32_t)prev), 0x01);
+    }
+
+    __attribute__((target("avx2")))
+    static __m256i pack(__m256i v, int mask) {
+        return _mm256_permutevar8x32_epi32(
+            v, _mm256_load_si256((const __m256i*)packTable().lanes32[mask]));
+    }
+
+    __attribute__((target("avx2")))
+    static int64_t last(__m256i v) { return _mm256_extract_epi32(v, 7); }
+};
+
+template <>
+struct Lanes<8> {
+    static const int W = 4;
+
+    __attribute__((target("avx2")))
+    static __m256i min(__m256i a, __m256i b) {
+        return _mm256_blendv_epi8(a, b, _mm256_cmpgt_epi64(a, b));
+    }
+
+    __attribute__((target("avx2")))
+    static __m256i max(__m256i a, __m256i b) {
+        return _mm256_blendv_epi8(b, a, _mm256_cmpgt_epi64(a, b));
+    }
+
+    __attribute__((target("avx2")))
+    static __m256i reverse(__m256i v) {
+        return _mm256_permute4x64_epi64(v, _MM_SHUFFLE(0, 1, 2, 3));
+    }
+
+    // Sort a bitonic vector: compare-exchange at distance 2, 1
+    __attribute__((target("avx2")))
+    static __m256i clean(__m256i v) {
+        __m256i t = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(1, 0, 3, 2));
+        v = _mm256_blend_epi32(min(v, t), max(v, t), 0xF0);
+        t = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(2, 3, 0, 1));
+        return _mm256_blend_epi32(min(v, t), max(v, t), 0xCC);
+    }
+
+    __attribute__((target("avx2")))
+    static int equal(__m256i a, __m256i b) {
+        return _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(a, b)));
+    }
+
+    __attribute__((target("avx2")))
+    static __m256i rotate(__m256i v) {
+        return _mm256_permute4x64_epi64(v, _MM_SHUFFLE(0, 3, 2, 1));
+    }
+
+    __attribute__((target("avx2")))
+    static __m256i shiftIn(__m256i v, int64_t prev) {
+        __m256i shifted = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(2, 1, 0, 0));
+        return _mm256_blend_epi32(shifted, _mm256_set1_epi64x(prev), 0x03);
+    }
+
+    __attribute__((target("avx2")))
+    static __m256i pack(__m256i v, int mask) {
+        return _mm256_permutevar8x32_epi32(
+            v, _mm256_load_si256((const __m256i*)packTable().lanes64[mask]));
+    }
+
+    __attribute__((target("avx2")))
+    static int64_t last(__m256i v) { return _mm256_extract_epi64(v, 3); }
+};
+
+template <typename T>
+__attribute__((target("avx2")))
+inline __m256i load(const T* p) {
+    return _mm256_loadu_si256((const __m256i*)p);
+}
+
+// Write the first "count" lanes of "v" at out[pos]. A full store is
+// cheaper, but may only touch out[0..room): with several threads the
+// slots past a piece's output belong to the next piece.
+template <typename T>
+__attribute__((target("avx2")))
+inline size_t put(__m256i v, int count, T* out, size_t pos, size_t room) {
+    const int W = Lanes<sizeof(T)>::W;
+    if (pos + W <= room) {
+        _mm256_storeu_si256((__m256i*)(out + pos), v);
+    } else {
+        T lanes[W];
+        _mm256_storeu_si256((__m256i*)lanes, v);
+        std::memcpy(out + pos, lanes, count * sizeof(T));
+    }
+    return pos + count;
+}
+
+// Writes a sorted stream, dropping keys equal to the one before
+template <typename T>
+struct DistinctWriter {
+    T* out;
+    size_t room;
+    size_t pos = 0;
+    T prev = T();
+    bool any = false;
+
+    __attribute__((target("avx2")))
+    void vector(__m256i v) {
+        typedef Lanes<sizeof(T)> L;
+        int mask = ~L::equal(v, L::shiftIn(v, (int64_t)prev)) & ((1 << L::W) - 1);
+        if (!any) {
+            mask |= 1;
+            any = true;
+        }
+        prev = (T)L::last(v);
+        pos = put(L::pack(v, mask), __builtin_popcount((unsigned)mask), out, pos, room);
+    }
+
+    void scalar(const T& key) {
+        if (!any || key != prev) {
+            out[pos++] = key;
+        }
+        prev = key;
+        any = true;
+    }
+};
+
+// Union: merge a vector of each run at a time, always refilling from
+// the run with the smaller next key, so every vector written is <=
+// all keys still to come. Once that run has less than a vector left,
+// the last merged vector and both tails finish in scalar code.
+template <typename T>
+__attribute__((target("avx2")))
+size_t unionAvx2(const T* a, size_t na, const T* b, size_t nb, T* out, size_t room) {
+    typedef Lanes<sizeof(T)> L;
+    const size_t W = L::W;
+    DistinctWriter<T> writer{out, room};
+    size_t i = 0, j = 0;
+    T carry[W];
+    size_t carried = 0;
+    if (na >= W && nb >= W) {
+        __m256i va = load(a);
+        __m256i vb = load(b);
+        i = j = W;
+        for (;;) {
+            __m256i rb = L::reverse(vb);
+            writer.vector(L::clean(L::min(va, rb)));
+            va = L::clean(L::max(va, rb));
+            bool fromA = i < na && (j >= nb || a[i] <= b[j]);
+            if (fromA ? i + W > na : j + W > nb) {
+                break;
+            }
+            vb = fromA ? load(a + i) : load(b + j);
+            (fromA ? i : j) += W;
+        }
+        _mm256_storeu_si256((__m256i*)carry, va);
+        carried = W;
+    }
+
+    size_t c = 0;
+    while (c < carried || i < na || j < nb) {
+        const T* pick = nullptr;
+        if (c < carried) {
+            pick = carry + c;
+        }
+        if (i < na && (!pick || a[i] < *pick)) {
+            pick = a + i;
+        }
+        if (j < nb && (!pick || b[j] < *pick)) {
+            pick = b + j;
+        }
+        writer.scalar(*pick);
+        if (pick == carry + c) {
+            c++;
+        } else if (pick == a + i) {
+            i++;
+        } else {
+            j++;
+        }
+    }
+    return writer.pos;
+}
+
+// Difference (kWrite) or the number of shared keys (!kWrite). The
+// vectors of a and b are compared lane against lane by W rotations;
+// a's vector is done once b's reaches its last key, and b's once
+// a's does.
+template <bool kWrite, typename T>
+__attribute__((target("avx2")))
+size_t compareAvx2(const T* a, size_t na, const T* b, size_t nb, T* out, size_t room) {
+    typedef Lanes<sizeof(T)> L;
+    const size_t W = L::W;
+    const int all = (1 << L::W) - 1;
+    size_t pos = 0, shared = 0;
+    size_t i = 0, j = 0;
+    int matched = 0; // lanes of a's vector at i found in b so far
+    while (i + W <= na && j + W <= nb) {
+        __m256i va = load(a + i);
+        __m256i vb = load(b + j);
+        for (size_t r = 0; r < W; r++) {
+            matched |= L::equal(va, vb);
+            vb = L::rotate(vb);
+        }
+        T aLast = a[i + W - 1];
+        T bLast = b[j + W - 1];
+        if (aLast <= bLast) {
+            if (kWrite) {
+                int keep = ~matched & all;
+                pos = put(L::pack(va, keep), __builtin_popcount((unsigned)keep), out, pos, room);
+            } else {
+                shared += __builtin_popcount((unsigned)matched);
+            }
+            i += W;
+            matched = 0;
+        }
+        if (bLast <= aLast) {
+            j += W;
+        }
+    }
+    for (size_t k = i; k < na; k++) {
+        while (j < nb && b[j] < a[k]) {
+            j++;
+        }
+        bool found = (k - i < W && (matched >> (k - i) & 1)) || (j < nb && b[j] == a[k]);
+        if (found) {
+            shared++;
+        } else if (kWrite) {
+            out[pos++] = a[k];
+        }
+    }
+    return kWrite ? pos : shared;
+}
+
+// Drop repeats in place. A vector is always stored at or behind where
+// it was loaded, so no key is overwritten before it is read.
+template <typename T>
+__attribute__((target("avx2")))
+size_t uniqueAvx2(T* keys, size_t n) {
+    typedef Lanes<sizeof(T)> L;
+    const size_t W = L::W;
+    if (n == 0) {
+        return 0;
+    }
+    T prev = keys[0];
+    size_t out = 1, i = 1;
+    for (; i + W <= n; i += W) {
+        __m256i v = load(keys + i);
+        int keep = ~L::equal(v, L::shiftIn(v, (int64_t)prev)) & ((1 << L::W) - 1);
+        prev = (T)L::last(v);
+        out = put(L::pack(v, keep), __builtin_popcount((unsigned)keep), keys, out, n);
+    }
+    for (; i < n; i++) {
+        T key = keys[i];
+        if (key != prev) {
+            keys[out++] = key;
+        }
+        prev = key;
+    }
+    return out;
+}
+
+} // namespace detail
+#endif
+
+// Sort-order equality
+template <typename T, typename Compare>
+bool sameKey(const T& a, const T& b, const Compare& comp) {
+    return !comp(a, b) && !comp(b, a);
+}
+
+// Remove repeats from the sorted keys[0..n); returns the new length
+template <typename T, typename Compare = std::less<T>>
+size_t uniqueSorted(T* keys, size_t n, Compare comp = Compare()) {
+#ifdef SET_KERNELS_X86
+    if constexpr (Simd<T, Compare>::kEqual) {
+        if (hasAvx2()) {
+            return detail::uniqueAvx2(keys, n);
+        }
+    }
+#endif
+    return std::unique(keys, keys + n,
+                       [&comp](const T& x, const T& y) { return sameKey(x, y, comp); })
+           - keys;
+}
+
+// out = a | b for duplicate-free a and b; only out[0..room) is
+// written, and "room" must hold the result
+template <typename T, typename Compare = std::less<T>>
+size_t setUnion(const T* a, size_t na, const T* b, size_t nb, T* out, size_t room,
+                Compare comp = Compare())
+{
+#ifdef SET_KERNELS_X86
+    if constexpr (Simd<T, Compare>::kMerge) {
+        if (hasAvx2()) {
+            return detail::unionAvx2(a, na, b, nb, out, room);
+        }
+    }
+#endif
+    (void)room;
+    return std::set_union(a, a + na, b, b + nb, out, comp) - out;
+}
+
+// out = a - b, with the same contract
+template <typename T, typename Compare = std::less<T>>
+size_t setDifference(const T* a, size_t na, const T* b, size_t nb, T* out, size_t room,
+                     Compare comp = Compare())
+{
+#ifdef SET_KERNELS_X86
+    if constexpr (Simd<T, Compare>::kEqual) {
+        if (hasAvx2()) {
+            return detail::compareAvx2<true>(a, na, b, nb, out, room);
+        }
+    }
+#endif
+    (void)room;
+    return std::set_difference(a, a + na, b, b + nb, out, comp) - out;
+}
+
+// |a & b| for duplicate-free a and b
+template <typename T, typename Compare = std::less<T>>
+size_t intersectionSize(const T* a, size_t na, const T* b, size_t nb,
+                        Compare comp = Compare())
+{
+#ifdef SET_KERNELS_X86
+    if constexpr (Simd<T, Compare>::kEqual) {
+        if (hasAvx2()) {
+            return detail::compareAvx2<false>(a, na, b, nb, (T*)nullptr, 0);
+        }
+    }
+#endif
+    return std::set_intersection(a, a + na, b, b + nb, CountingOutput(), comp).n;
+}
+
+} // namespace set_kernels
+
+#endif // SET_KERNELS_H
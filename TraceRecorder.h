@@ -0,0 +1,261 @@
+#ifndef TRACE_RECORDER_H
+#define TRACE_RECORDER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ----------------------------------------------------
+// Trace file format
+//   TraceFileHeader followed by TraceRecord entries. Records of
+//   different threads are interleaved in flush order; sort them by
+//   timestamp to get the global order.
+// ----------------------------------------------------
+enum class TraceOp : uint8_t {
+    Insert = 1,
+    Remove = 2,
+    Search = 3
+};
+
+#pragma pack(push, 1)
+struct TraceFileHeader {
+    char magic[8];       // "AVLTRACE"
+    uint32_t version;
+    uint32_t recordSize;
+};
+
+struct TraceRecord {
+    uint64_t timestampNs; // since the recorder was opened
+    int64_t key;
+    uint32_t durationNs;
+    uint16_t thread;      // small id, in order of first use
+    uint8_t op;           // TraceOp
+    uint8_t result;       // search: found; insert/remove: size changed
+};
+#pragma pack(pop)
+
+static const uint32_t kTraceVersion = 1;
+
+// ----------------------------------------------------
+// TraceRecorder
+//   Each recording thread fills its own fixed-size buffer without
+//   taking a lock. Full buffers are queued to a writer thread that
+//   appends them to the file, so the caller never waits on I/O.
+//
+//   stop() (or the destructor) flushes the partially filled buffers;
+//   it must only be called once the recording threads are done.
+// ----------------------------------------------------
+class TraceRecorder {
+public:
+    static const size_t kBufferRecords = 4096;
+
+    explicit TraceRecorder(const std::string& path)
+        : file(std::fopen(path.c_str(), "wb")),
+          id(nextId()),
+          epoch(std::chrono::steady_clock::now()),
+          threadCount(0),
+          stopping(false),
+          dropped(0)
+    {
+        if (file) {
+            TraceFileHeader header;
+            std::memcpy(header.magic, "AVLTRACE", 8);
+            header.version = kTraceVersion;
+            header.recordSize = sizeof(TraceRecord);
+            std::fwrite(&header, sizeof(header), 1, file);
+            writer = std::thread(&TraceRecorder::writerLoop, this);
+        }
+    }
+
+    ~TraceRecorder() {
+        stop();
+    }
+
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+    bool isOpen() const {
+        return file != nullptr;
+    }
+
+    // Nanoseconds since the recorder was opened
+    uint64_t now() const {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    void record(TraceOp op, int64_t key, uint64_t startNs, bool result) {
+        if (!file) {
+            return;
+        }
+        uint64_t endNs = now();
+        ThreadBuffer* buf = localBuffer();
+        TraceRecord& r = buf->block->records[buf->block->count++];
+        r.timestampNs = startNs;
+        r.key = key;
+        r.durationNs = (uint32_t)std::min<uint64_t>(endNs - startNs, UINT32_MAX);
+        r.thread = buf->thread;
+        r.op = (uint8_t)op;
+        r.result = result ? 1 : 0;
+        if (buf->block->count == kBufferRecords) {
+            handOff(buf);
+        }
+    }
+
+    // Flush every buffer and close the file
+    void stop() {
+        if (!file) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            for (auto& buf : threads) {
+                if (buf->block && buf->block->count > 0) {
+                    fullBlocks.push_back(std::move(buf->block));
+                }
+            }
+            stopping = true;
+        }
+        wake.notify_one();
+        writer.join();
+        std::fclose(file);
+        file = nullptr;
+    }
+
+    // Records lost because the file could not be written
+    uint64_t droppedRecords() const {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Block {
+        size_t count = 0;
+        TraceRecord records[kBufferRecords];
+    };
+
+    struct ThreadBuffer {
+        uint16_t thread;
+        std::unique_ptr<Block> block;
+    };
+
+    // Per-thread map from recorder id to the buffer it owns
+    struct LocalSlot {
+        uint64_t owner;
+        ThreadBuffer* buffer;
+    };
+
+    std::FILE* file;
+    const uint64_t id;
+    const std::chrono::steady_clock::time_point epoch;
+
+    std::mutex mtx;
+    std::condition_variable wake;
+    std::vector<std::unique_ptr<ThreadBuffer>> threads;
+    std::vector<std::unique_ptr<Block>> fullBlocks;
+    std::vector<std::unique_ptr<Block>> freeBlocks;
+    uint16_t threadCount;
+    bool stopping;
+    std::atomic<uint64_t> dropped;
+    std::thread writer;
+
+    static uint64_t nextId() {
+        static std::atomic<uint64_t> counter(1);
+        return counter.fetch_add(1);
+    }
+
+    ThreadBuffer* localBuffer() {
+        static thread_local std::vector<LocalSlot> slots;
+        for (const auto& slot : slots) {
+            if (slot.owner == id) {
+                return slot.buffer;
+            }
+        }
+        std::lock_guard<std::mutex> lock(mtx);
+        threads.emplace_back(new ThreadBuffer());
+        threads.back()->thread = threadCount++;
+        threads.back()->block.reset(new Block());
+        slots.push_back({id, threads.back().get()});
+        return threads.back().get();
+    }
+
+    // Queue a full block for the writer and take an empty one
+    void handOff(ThreadBuffer* buf) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            fullBlocks.push_back(std::move(buf->block));
+            if (!freeBlocks.empty()) {
+                buf->block = std::move(freeBlocks.back());
+                freeBlocks.pop_back();
+            }
+        }
+        wake.notify_one();
+        if (!buf->block) {
+            buf->block.reset(new Block());
+        }
+        buf->block->count = 0;
+    }
+
+    void writerLoop() {
+        std::vector<std::unique_ptr<Block>> batch;
+        for (;;) {
+            bool done;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                wake.wait(lock, [&] { return stopping || !fullBlocks.empty(); });
+                batch.swap(fullBlocks);
+                done = stopping;
+            }
+            for (auto& block : batch) {
+                size_t written = std::fwrite(block->records, sizeof(TraceRecord), block->count, file);
+                dropped.fetch_add(block->count - written, std::memory_order_relaxed);
+            }
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                for (auto& block : batch) {
+                    freeBlocks.push_back(std::move(block));
+                }
+            }
+            batch.clear();
+            if (done) {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (fullBlocks.empty()) {
+                    return;
+                }
+            }
+        }
+    }
+};
+
+// ----------------------------------------------------
+// Reading a trace back
+// ----------------------------------------------------
+inline bool readTrace(const std::string& path, std::vector<TraceRecord>& out) {
+    std::FILE* in = std::fopen(path.c_str(), "rb");
+    if (!in) {
+        return false;
+    }
+    TraceFileHeader header;
+    bool ok = std::fread(&header, sizeof(header), 1, in) == 1
+              && std::memcmp(header.magic, "AVLTRACE", 8) == 0
+              && header.version == kTraceVersion
+              && header.recordSize == sizeof(TraceRecord);
+    if (ok) {
+        TraceRecord r;
+        while (std::fread(&r, sizeof(r), 1, in) == 1) {
+            out.push_back(r);
+        }
+    }
+    std::fclose(in);
+    return ok;
+}
+
+#endif // TRACE_RECORDER_H
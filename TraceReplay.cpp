@@ -0,0 +1,255 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BenchEngines.h"
+#include "TraceRecorder.h"
+
+using namespace std;
+
+// ----------------------------------------------------
+// Trace replayer
+//   Re-executes a trace written by TraceRecorder against one of the
+//   benchmark engines, either serially in timestamp order or, for
+//   thread-safe engines, with one thread per recorded thread sharing
+//   the engine without a lock, and reports the latency distribution
+//   next to the latencies that were recorded originally. Keys are
+//   replayed as the int64_t values the trace stores.
+// ----------------------------------------------------
+struct ReplayOptions {
+    string tracePath;
+    string engine = "avl";
+    bool concurrent = false;
+    bool paced = false;
+    bool inferInitial = true;
+};
+
+typedef chrono::steady_clock ReplayClock;
+
+static const char* opName(uint8_t op) {
+    switch ((TraceOp)op) {
+    case TraceOp::Insert: return "insert";
+    case TraceOp::Remove: return "remove";
+    case TraceOp::Search: return "search";
+    }
+    return "unknown";
+}
+
+// Keys the trace proves were present before the first recorded
+// operation: found, removed, or rejected as duplicates before any
+// insert of theirs succeeded. Keys the trace never touches cannot be
+// recovered.
+static vector<int64_t> inferInitialKeys(const vector<TraceRecord>& trace) {
+    set<int64_t> seen;
+    vector<int64_t> initial;
+    for (const auto& r : trace) {
+        if (seen.count(r.key)) {
+            continue;
+        }
+        bool present =
+            ((TraceOp)r.op == TraceOp::Search && r.result) ||
+            ((TraceOp)r.op == TraceOp::Remove && r.result) ||
+            ((TraceOp)r.op == TraceOp::Insert && !r.result);
+        seen.insert(r.key);
+        if (present) {
+            initial.push_back(r.key);
+        }
+    }
+    return initial;
+}
+
+template <typename Engine>
+static bool apply(Engine& e, const TraceRecord& r) {
+    switch ((TraceOp)r.op) {
+    case TraceOp::Insert: e.insert(r.key); return false;
+    case TraceOp::Remove: e.erase(r.key); return false;
+    case TraceOp::Search: return e.contains(r.key);
+    }
+    return false;
+}
+
+// Sleep until "offsetNs" after "start"
+static void waitUntil(ReplayClock::time_point start, uint64_t offsetNs) {
+    auto target = start + chrono::nanoseconds(offsetNs);
+    if (ReplayClock::now() < target) {
+        this_thread::sleep_until(target);
+    }
+}
+
+static void printPercentiles(const string& label, vector<uint64_t>& v) {
+    if (v.empty()) {
+        return;
+    }
+    sort(v.begin(), v.end());
+    auto pct = [&](double p) { return v[min(v.size() - 1, (size_t)(p * v.size()))]; };
+    cout << left << setw(18) << label << right
+         << setw(10) << v.size()
+         << setw(12) << pct(0.50)
+         << setw(12) << pct(0.90)
+         << setw(12) << pct(0.99)
+         << setw(12) << pct(0.999)
+         << setw(14) << v.back() << "\n";
+}
+
+template <typename Engine>
+static void replay(const vector<TraceRecord>& trace, const ReplayOptions& opt) {
+    Engine e;
+    if (opt.inferInitial) {
+        vector<int64_t> initial = inferInitialKeys(trace);
+        e.bulkLoad(initial);
+        cout << "Preloaded " << initial.size() << " keys inferred from the trace\n";
+    }
+
+    // replayed[i] is the latency of trace[i]
+    vector<uint64_t> replayed(trace.size(), 0);
+    size_t mismatches = 0;
+    uint64_t firstTs = trace.empty() ? 0 : trace.front().timestampNs;
+    auto start = ReplayClock::now();
+
+    if (!opt.concurrent) {
+        for (size_t i = 0; i < trace.size(); i++) {
+            const TraceRecord& r = trace[i];
+            if (opt.paced) {
+                waitUntil(start, r.timestampNs - firstTs);
+            }
+            auto t0 = ReplayClock::now();
+            bool found = apply(e, r);
+            replayed[i] = (uint64_t)chrono::duration_cast<chrono::nanoseconds>(ReplayClock::now() - t0).count();
+            if ((TraceOp)r.op == TraceOp::Search && found != (r.result != 0)) {
+                mismatches++;
+            }
+        }
+    } else {
+        // One replay thread per recorded thread, all calling the
+        // engine at once (main() only allows thread-safe engines)
+        map<uint16_t, vector<size_t>> byThread;
+        for (size_t i = 0; i < trace.size(); i++) {
+            byThread[trace[i].thread].push_back(i);
+        }
+        vector<thread> workers;
+        for (const auto& entry : byThread) {
+            const vector<size_t>& indices = entry.second;
+            workers.emplace_back([&, indices]() {
+                for (size_t i : indices) {
+                    const TraceRecord& r = trace[i];
+                    if (opt.paced) {
+                        waitUntil(start, r.timestampNs - firstTs);
+                    }
+                    auto t0 = ReplayClock::now();
+                    apply(e, r);
+                    replayed[i] = (uint64_t)chrono::duration_cast<chrono::nanoseconds>(ReplayClock::now() - t0).count();
+                }
+            });
+        }
+        for (auto& w : workers) {
+            w.join();
+        }
+    }
+
+    double wallMs = chrono::duration<double, milli>(ReplayClock::now() - start).count();
+
+    cout << "Engine " << Engine::name() << ", " << trace.size() << " ops, "
+         << (opt.concurrent ? "concurrent" : "serial")
+         << (opt.paced ? " (paced)" : "") << ", wall " << wallMs << " ms\n";
+    if (!opt.concurrent) {
+        cout << "Search results differing from the trace: " << mismatches << "\n";
+    }
+
+    cout << left << setw(18) << "latency (ns)" << right
+         << setw(10) << "count" << setw(12) << "p50" << setw(12) << "p90"
+         << setw(12) << "p99" << setw(12) << "p99.9" << setw(14) << "max" << "\n";
+    const TraceOp ops[] = {TraceOp::Insert, TraceOp::Remove, TraceOp::Search};
+    for (TraceOp op : ops) {
+        vector<uint64_t> original;
+        vector<uint64_t> now;
+        for (size_t i = 0; i < trace.size(); i++) {
+            if ((TraceOp)trace[i].op == op) {
+                original.push_back(trace[i].durationNs);
+                now.push_back(replayed[i]);
+            }
+        }
+        printPercentiles(string(opName((uint8_t)op)) + " recorded", original);
+        printPercentiles(string(opName((uint8_t)op)) + " replayed", now);
+    }
+}
+
+static void printUsage(const char* prog) {
+    string engines;
+    forEachEngine<int64_t>([&](auto, const char* id) {
+        engines += engines.empty() ? id : string("|") + id;
+    });
+    cout << "Usage: " << prog << " TRACE [--engine " << engines << "]"
+         << " [--concurrent] [--paced] [--no-infer-initial]" << endl;
+}
+
+// ----------------------------------------------------
+// Main
+// ----------------------------------------------------
+int main(int argc, char** argv) {
+    ReplayOptions opt;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--engine" && i + 1 < argc) {
+            opt.engine = argv[++i];
+        } else if (arg == "--concurrent") {
+            opt.concurrent = true;
+        } else if (arg == "--paced") {
+            opt.paced = true;
+        } else if (arg == "--no-infer-initial") {
+            opt.inferInitial = false;
+        } else if (opt.tracePath.empty() && arg[0] != '-') {
+            opt.tracePath = arg;
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (opt.tracePath.empty()) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    vector<TraceRecord> trace;
+    if (!readTrace(opt.tracePath, trace)) {
+        cout << "Error reading trace '" << opt.tracePath << "'" << endl;
+        return -1;
+    }
+    stable_sort(trace.begin(), trace.end(), [](const TraceRecord& a, const TraceRecord& b) {
+        return a.timestampNs < b.timestampNs;
+    });
+
+    // Engines are picked by their short id or by the name they report
+    bool known = false;
+    int status = 0;
+    forEachEngine<int64_t>([&](auto tag, const char* id) {
+        typedef typename decltype(tag)::type Engine;
+        if (known || (opt.engine != id && opt.engine != Engine::name())) {
+            return;
+        }
+        known = true;
+        if (opt.concurrent && !Engine::threadSafe) {
+            cout << "Engine " << Engine::name() << " is not thread safe; --concurrent needs one of:";
+            forEachEngine<int64_t>([&](auto other, const char* otherId) {
+                if (decltype(other)::type::threadSafe) {
+                    cout << " " << otherId;
+                }
+            });
+            cout << endl;
+            status = 1;
+            return;
+        }
+        replay<Engine>(trace, opt);
+    });
+    if (!known) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    return status;
+}
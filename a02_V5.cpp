@@ -7,16 +7,10 @@
 #include <SFML/Graphics.hpp>
 #include <sstream>
 
-using namespace std;
-
-// ----------------------------------------------------
-// Forward declarations
-// ----------------------------------------------------
-template <typename T>
-class AVLNode;
+#include "AVLTree.h"
+#include "Profiler.h"
 
-template <typename T>
-class AVLTree;
+using namespace std;
 
 // Global SFML Window pointer (used by animation).
 sf::RenderWindow* globalWindowPtr = nullptr;
@@ -25,168 +19,170 @@ sf::RenderWindow* globalWindowPtr = nullptr;
 sf::Font globalFont;
 
 // ----------------------------------------------------
-// AVL Node Definition
-// ----------------------------------------------------
-template <typename T>
-class AVLNode {
-public:
-    T key;
-    AVLNode* left;
-    AVLNode* right;
-    int height;
-
-    AVLNode(T k)
-        : key(k), left(nullptr), right(nullptr), height(1)
-    {}
-};
-
+// Profiler overlay state (F1 toggles the overlay)
 // ----------------------------------------------------
-// "Special AVL" Tree
-//   - Maintains a sorted vector of keys
-//   - Rebuilds a perfectly balanced tree on each insert
-// ----------------------------------------------------
-template <typename T>
-class AVLTree {
-private:
-    AVLNode<T>* root;
-    vector<T> sortedElements; // Always keeps keys in sorted order
-
-    // Compute the node's height
-    int height(AVLNode<T>* node) {
-        return (node == nullptr) ? 0 : node->height;
-    }
-
-    // Build a perfectly balanced BST from sortedElements[start..end]
-    // For an even count of elements, pick the "upper" middle:
-    //    mid = (start + end + 1) / 2
-    AVLNode<T>* buildBalancedTree(int start, int end) {
-        if (start > end) {
-            return nullptr;
-        }
-
-        int mid = (start + end + 1) / 2; // "upper" middle
-        AVLNode<T>* node = new AVLNode<T>(sortedElements[mid]);
-
-        node->left  = buildBalancedTree(start, mid - 1);
-        node->right = buildBalancedTree(mid + 1, end);
+bool showProfiler = true;
+ProfileStat drawTreeStat;    // per frame
+ProfileStat animateTaskStat; // per call
+ProfileStat insertStat;      // per call
+ProfileStat frameStat;       // whole frame, measured between displays
+sf::Clock frameClock;
+unsigned frameDrawCalls = 0;
+unsigned lastFrameDrawCalls = 0;
+
+// window.draw() wrappers that count draw calls for the overlay
+void countedDraw(sf::RenderWindow &window, const sf::Drawable &drawable) {
+    window.draw(drawable);
+    frameDrawCalls++;
+}
 
-        int lh = height(node->left);
-        int rh = height(node->right);
-        node->height = 1 + std::max(lh, rh);
+void countedDraw(sf::RenderWindow &window, const sf::Vertex *vertices,
+                 size_t count, sf::PrimitiveType type) {
+    window.draw(vertices, count, type);
+    frameDrawCalls++;
+}
 
-        return node;
+// Draw the profiler overlay (top-left), present the frame and roll
+// the per-frame counters over.
+void presentFrame(sf::RenderWindow &window, const AVLTree<int>& tree) {
+    if (showProfiler) {
+        std::ostringstream os;
+        os.setf(std::ios::fixed);
+        os.precision(2);
+        os << "frame " << frameStat.lastMs() << " ms\n"
+           << "draw calls " << lastFrameDrawCalls << "\n"
+           << "drawTree " << drawTreeStat.frameMs() << " ms/frame\n"
+           << "animateTask " << animateTaskStat.lastMs() << " ms (last)\n"
+           << "avl.insert " << insertStat.lastMs() << " ms (last)\n"
+           << "rebuild " << tree.rebuildStats().lastMs() << " ms (last)";
+
+        sf::Text stats;
+        stats.setFont(globalFont);
+        stats.setString(os.str());
+        stats.setCharacterSize(16);
+        stats.setFillColor(sf::Color::Green);
+        stats.setPosition(10.f, 10.f);
+        countedDraw(window, stats);
     }
 
-    // Insert into the sorted vector (if not a duplicate), then rebuild
-    AVLNode<T>* insertRebuild(T key) {
-        auto it = std::lower_bound(sortedElements.begin(), sortedElements.end(), key);
-        if (it == sortedElements.end() || *it != key) {
-            sortedElements.insert(it, key);
-        }
-        return buildBalancedTree(0, (int)sortedElements.size() - 1);
-    }
+    window.display();
 
-    // Remove from the sorted vector (if present), then rebuild
-    AVLNode<T>* deleteRebuild(T key) {
-        auto it = std::lower_bound(sortedElements.begin(), sortedElements.end(), key);
-        if (it != sortedElements.end() && *it == key) {
-            sortedElements.erase(it);
-        }
-        if (sortedElements.empty()) {
-            return nullptr;
-        }
-        return buildBalancedTree(0, (int)sortedElements.size() - 1);
-    }
+    frameStat.add((uint64_t)frameClock.restart().asMicroseconds() * 1000);
+    drawTreeStat.endFrame();
+    lastFrameDrawCalls = frameDrawCalls;
+    frameDrawCalls = 0;
+}
 
-    // Standard BST search
-    bool searchBST(AVLNode<T>* node, T key) {
-        if (!node) {
-            return false;
-        }
-        if (node->key == key) {
+// ----------------------------------------------------
+// Utility to check if a node is in the search path
+// ----------------------------------------------------
+bool isNodeInPath(AVLNode<int>* node, const vector<AVLNode<int>*>& path) {
+    for (auto* p : path) {
+        if (p == node) {
             return true;
         }
-        if (key < node->key) {
-            return searchBST(node->left, key);
-        } else {
-            return searchBST(node->right, key);
-        }
     }
+    return false;
+}
 
-    // For debugging: In-order traversal
-    void inorder(AVLNode<T>* node) {
-        if (node) {
-            inorder(node->left);
-            cout << node->key << " ";
-            inorder(node->right);
-        }
-    }
+// ----------------------------------------------------
+// Access heatmap (F2 toggles it)
+// ----------------------------------------------------
+bool showHeatmap = false;
 
-public:
-    AVLTree() : root(nullptr) {}
+// Largest visit count in the subtree
+unsigned maxVisits(AVLNode<int>* node) {
+    if (!node) return 0;
+    unsigned v = node->visits.load(std::memory_order_relaxed);
+    return std::max(v, std::max(maxVisits(node->left), maxVisits(node->right)));
+}
 
-    // Public Insert
-    void insert(T key) {
-        root = insertRebuild(key);
-    }
+// Blue for cold nodes, red for the hottest one. Log scale, so that a
+// few very hot keys do not wash out the rest of the tree.
+sf::Color heatColor(unsigned visits, unsigned hottest) {
+    float t = (hottest == 0) ? 0.f
+                             : std::log1p((float)visits) / std::log1p((float)hottest);
+    return sf::Color((sf::Uint8)(40 + 200 * t),
+                     (sf::Uint8)(40 * (1 - t)),
+                     (sf::Uint8)(220 * (1 - t)));
+}
 
-    // Public Remove
-    void remove(T key) {
-        root = deleteRebuild(key);
-    }
+// ----------------------------------------------------
+// Batched SFML Drawing with optional path highlight
+//   Edges and circles of the whole tree are collected into two vertex
+//   arrays and drawn with one call each; only the labels are drawn
+//   per node.
+// ----------------------------------------------------
+struct NodeLabel {
+    int key;
+    float x;
+    float y;
+};
 
-    // Public Search
-    bool search(T key) {
-        return searchBST(root, key);
+// Append a filled circle to a sf::Triangles vertex array
+void appendCircle(sf::VertexArray &tris, float x, float y, float radius, sf::Color color) {
+    const int segments = 30;
+    const float step = 2.f * 3.14159265f / segments;
+    for (int i = 0; i < segments; i++) {
+        tris.append(sf::Vertex(sf::Vector2f(x, y), color));
+        tris.append(sf::Vertex(sf::Vector2f(x + radius * std::cos(i * step),
+                                            y + radius * std::sin(i * step)), color));
+        tris.append(sf::Vertex(sf::Vector2f(x + radius * std::cos((i + 1) * step),
+                                            y + radius * std::sin((i + 1) * step)), color));
     }
+}
 
-    // Print Inorder
-    void printInorder() {
-        inorder(root);
-        cout << endl;
-    }
+void buildTreeGeometry(AVLNode<int>* node,
+                       float x,
+                       float y,
+                       float horizontalOffset,
+                       const vector<AVLNode<int>*>& searchPath,
+                       unsigned hottest,
+                       sf::VertexArray &edges,
+                       sf::VertexArray &circles,
+                       vector<NodeLabel> &labels)
+{
+    if (!node) return;
 
-    // Access the root (for drawing, etc.)
-    AVLNode<T>* getRoot() {
-        return root;
-    }
+    const float radius = 30.f;
+    const float verticalSpacing = 100.f;
+    bool highlight = isNodeInPath(node, searchPath);
 
-    // Return the path (node pointers) visited during a search for "key"
-    // This is used for highlighting the path in the SFML drawing.
-    vector<AVLNode<T>*> getSearchPath(T key) {
-        vector<AVLNode<T>*> path;
-        AVLNode<T>* current = root;
-        while (current) {
-            path.push_back(current);
-            if (current->key == key) {
-                break;
-            }
-            else if (key < current->key) {
-                current = current->left;
-            }
-            else {
-                current = current->right;
-            }
-        }
-        return path;
+    AVLNode<int>* children[2] = { node->left, node->right };
+    for (int side = 0; side < 2; side++) {
+        AVLNode<int>* child = children[side];
+        if (!child) continue;
+
+        float childX = (side == 0) ? x - horizontalOffset : x + horizontalOffset;
+        float childY = y + verticalSpacing;
+
+        bool childHighlight = highlight && isNodeInPath(child, searchPath);
+        sf::Color edgeColor = childHighlight ? sf::Color::Red : sf::Color::Yellow;
+        edges.append(sf::Vertex(sf::Vector2f(x, y + radius), edgeColor));
+        edges.append(sf::Vertex(sf::Vector2f(childX, childY - radius), edgeColor));
+
+        buildTreeGeometry(child, childX, childY, horizontalOffset / 2,
+                          searchPath, hottest, edges, circles, labels);
     }
-};
 
-// ----------------------------------------------------
-// Utility to check if a node is in the search path
-// ----------------------------------------------------
-bool isNodeInPath(AVLNode<int>* node, const vector<AVLNode<int>*>& path) {
-    for (auto* p : path) {
-        if (p == node) {
-            return true;
+    // Outline first, then the fill on top of it. In heatmap mode the
+    // fill shows the heat and the search path is marked by the outline.
+    sf::Color fill;
+    sf::Color outline = sf::Color::White;
+    if (showHeatmap) {
+        fill = heatColor(node->visits.load(std::memory_order_relaxed), hottest);
+        if (highlight) {
+            outline = sf::Color::Red;
         }
+    } else {
+        fill = highlight ? sf::Color::Red : sf::Color::Yellow;
     }
-    return false;
+    appendCircle(circles, x, y, radius + 3.f, outline);
+    appendCircle(circles, x, y, radius, fill);
+
+    labels.push_back({node->key, x, y});
 }
 
-// ----------------------------------------------------
-// Recursive SFML Drawing with optional path highlight
-// ----------------------------------------------------
 void drawTree(sf::RenderWindow &window,
               AVLNode<int>* node,
               float x,
@@ -196,78 +192,185 @@ void drawTree(sf::RenderWindow &window,
 {
     if (!node) return;
 
-    const float radius = 30.f;
-    bool highlight = isNodeInPath(node, searchPath);
+    unsigned hottest = showHeatmap ? maxVisits(node) : 0;
 
-    // Draw the node circle
-    sf::CircleShape circle(radius);
-    circle.setOrigin(radius, radius);
-    circle.setPosition(x, y);
+    sf::VertexArray edges(sf::Lines);
+    sf::VertexArray circles(sf::Triangles);
+    vector<NodeLabel> labels;
+    buildTreeGeometry(node, x, y, horizontalOffset, searchPath, hottest,
+                      edges, circles, labels);
 
-    if (highlight) {
-        circle.setFillColor(sf::Color::Red);
-        circle.setOutlineColor(sf::Color::White);
-        circle.setOutlineThickness(3);
-    } else {
-        circle.setFillColor(sf::Color::Yellow);
-        circle.setOutlineColor(sf::Color::White);
-        circle.setOutlineThickness(3);
-    }
+    countedDraw(window, edges);
+    countedDraw(window, circles);
 
     // Node text
     sf::Text text;
     text.setFont(globalFont);
-    text.setString(std::to_string(node->key));
     text.setCharacterSize(24);
-    text.setFillColor(sf::Color::Black);
+    text.setFillColor(showHeatmap ? sf::Color::White : sf::Color::Black);
     text.setStyle(sf::Text::Bold);
+    for (const NodeLabel& label : labels) {
+        text.setString(std::to_string(label.key));
+        sf::FloatRect textRect = text.getLocalBounds();
+        text.setOrigin(textRect.left + textRect.width / 2.0f,
+                       textRect.top + textRect.height / 2.0f);
+        text.setPosition(label.x, label.y);
+        countedDraw(window, text);
+    }
+}
 
-    sf::FloatRect textRect = text.getLocalBounds();
-    text.setOrigin(textRect.left + textRect.width / 2.0f,
-                   textRect.top + textRect.height / 2.0f);
-    text.setPosition(x, y);
-
-    float verticalSpacing = 100.f;
-
-    // Draw left child edge
-    if (node->left) {
-        float childX = x - horizontalOffset;
-        float childY = y + verticalSpacing;
-
-        bool childHighlight = highlight && isNodeInPath(node->left, searchPath);
-
-        sf::Vertex line[] = {
-            sf::Vertex(sf::Vector2f(x, y + radius),
-                       childHighlight ? sf::Color::Red : sf::Color::Yellow),
-            sf::Vertex(sf::Vector2f(childX, childY - radius),
-                       childHighlight ? sf::Color::Red : sf::Color::Yellow)
-        };
-        window.draw(line, 2, sf::Lines);
+// ----------------------------------------------------
+// Rank-space density view (F3 toggles it)
+//   For big trees one circle per node is meaningless. Instead every
+//   row is a depth level and every pixel column a range of ranks; the
+//   brightness is the number of nodes of that level in that range.
+//   The shape of the tree depends only on n and the upper-middle
+//   rule, so the counts are computed from ranks, without touching the
+//   nodes: O(pixels) per redraw of the image, whatever n is (see
+//   densityCounts).
+// ----------------------------------------------------
+bool showDensity = false;
+
+// Node counts of the density view: counts[d * width + c] is the
+// number of depth-d nodes whose rank falls in column c, where column c
+// holds the ranks r with ((r + 1) * width - 1) / n == c.
+//
+// The implicit tree is walked top-down. A range that spans a column
+// boundary adds its middle node and splits; each boundary crosses one
+// range per level, so at most width * levels ranges split. A range
+// that lies inside one column is not opened: a subtree of s keys has
+// full levels 1, 2, 4, ... down to the last one, which holds
+// s - 2^(h-1) + 1 nodes (h = its height). It is recorded in O(1) as a
+// doubling run starting at its root's row, cancelled below its last
+// full row, and one final sweep per column expands the runs.
+// O(pixels) in all, whatever n is.
+vector<long long> densityCounts(long long n, unsigned width, int levels) {
+    vector<long long> counts((size_t)levels * width, 0);
+    vector<long long> runStart((size_t)levels * width, 0);
+    vector<long long> runStop((size_t)levels * width, 0);
+    auto column = [&](long long rank) {
+        return (unsigned)(((rank + 1) * (long long)width - 1) / n);
+    };
+    auto at = [&](int d, unsigned c) {
+        return (size_t)d * width + c;
+    };
 
-        drawTree(window, node->left, childX, childY, horizontalOffset / 2, searchPath);
+    struct Range {
+        long long lo;
+        long long hi;
+        int depth;
+    };
+    vector<Range> stack = { {0, n - 1, 0} };
+    while (!stack.empty()) {
+        Range p = stack.back();
+        stack.pop_back();
+        if (p.lo > p.hi) continue;
+        unsigned c = column(p.lo);
+        if (c == column(p.hi)) {
+            long long size = p.hi - p.lo + 1;
+            int h = 0;
+            while ((1LL << h) <= size) h++;
+            int last = p.depth + h - 1;
+            if (h > 1) {
+                runStart[at(p.depth, c)] += 1;
+                runStop[at(last, c)] += 1LL << (h - 1);
+            }
+            counts[at(last, c)] += size - (1LL << (h - 1)) + 1;
+            continue;
+        }
+        long long mid = (p.lo + p.hi + 1) / 2; // "upper" middle
+        counts[at(p.depth, column(mid))]++;
+        stack.push_back({p.lo, mid - 1, p.depth + 1});
+        stack.push_back({mid + 1, p.hi, p.depth + 1});
     }
 
-    // Draw right child edge
-    if (node->right) {
-        float childX = x + horizontalOffset;
-        float childY = y + verticalSpacing;
+    for (unsigned c = 0; c < width; c++) {
+        long long run = 0;
+        for (int d = 0; d < levels; d++) {
+            run = 2 * run + runStart[at(d, c)] - runStop[at(d, c)];
+            counts[at(d, c)] += run;
+        }
+    }
+    return counts;
+}
 
-        bool childHighlight = highlight && isNodeInPath(node->right, searchPath);
+// Cached density image. The shape, and so the image, depends only on
+// the number of keys, so it is recomputed when that or the window
+// width changes. The root is no key: appends reshape the tree in
+// place and keep it.
+struct DensityImage {
+    long long keys = 0;
+    unsigned width = 0;
+    int levels = 0;
+    sf::Image image;
+    sf::Texture texture;
+};
+DensityImage densityImage;
 
-        sf::Vertex line[] = {
-            sf::Vertex(sf::Vector2f(x, y + radius),
-                       childHighlight ? sf::Color::Red : sf::Color::Yellow),
-            sf::Vertex(sf::Vector2f(childX, childY - radius),
-                       childHighlight ? sf::Color::Red : sf::Color::Yellow)
-        };
-        window.draw(line, 2, sf::Lines);
+void drawDensityView(sf::RenderWindow &window,
+                     AVLTree<int>& tree,
+                     const vector<AVLNode<int>*>& searchPath)
+{
+    AVLNode<int>* root = tree.getRoot();
+    if (!root) return;
+
+    const vector<int>& keys = tree.getSortedElements();
+    long long n = (long long)keys.size();
+    unsigned width = window.getSize().x;
+    int levels = root->height;
+    const float top = 50.f;
+    const float bandHeight = (window.getSize().y - top - 70.f) / levels;
+
+    if (densityImage.keys != n || densityImage.width != width) {
+        densityImage.keys = n;
+        densityImage.width = width;
+        densityImage.levels = levels;
+        densityImage.image.create(width, levels, sf::Color::Black);
+        vector<long long> counts = densityCounts(n, width, levels);
+        for (int d = 0; d < levels; d++) {
+            const long long* row = &counts[(size_t)d * width];
+            long long rowMax = std::max(1LL, *std::max_element(row, row + width));
+            for (unsigned c = 0; c < width; c++) {
+                if (row[c] == 0) continue;
+                float t = 0.35f + 0.65f * row[c] / rowMax;
+                densityImage.image.setPixel(c, d, sf::Color((sf::Uint8)(255 * t),
+                                                            (sf::Uint8)(220 * t), 0));
+            }
+        }
+        densityImage.texture.loadFromImage(densityImage.image);
+    }
 
-        drawTree(window, node->right, childX, childY, horizontalOffset / 2, searchPath);
+    sf::Sprite sprite(densityImage.texture);
+    sprite.setPosition(0.f, top);
+    sprite.setScale(1.f, bandHeight);
+    countedDraw(window, sprite);
+
+    // Search path as a polyline through (rank, depth) of each node
+    if (!searchPath.empty()) {
+        sf::VertexArray polyline(sf::LineStrip);
+        for (size_t d = 0; d < searchPath.size(); d++) {
+            long long rank = std::lower_bound(keys.begin(), keys.end(), searchPath[d]->key) - keys.begin();
+            float px = (rank + 0.5f) * width / n;
+            float py = top + (d + 0.5f) * bandHeight;
+            polyline.append(sf::Vertex(sf::Vector2f(px, py), sf::Color::Red));
+        }
+        countedDraw(window, polyline);
     }
+}
 
-    // Finally draw the circle and the text
-    window.draw(circle);
-    window.draw(text);
+// Draw the tree in the current view mode
+void drawView(sf::RenderWindow &window,
+              AVLTree<int>& tree,
+              const vector<AVLNode<int>*>& searchPath)
+{
+    ScopedTimer drawTimer(drawTreeStat);
+    if (showDensity) {
+        drawDensityView(window, tree, searchPath);
+    } else {
+        drawTree(window, tree.getRoot(),
+                 window.getSize().x / 2.f, 50.f,
+                 300.f, searchPath);
+    }
 }
 
 // ----------------------------------------------------
@@ -279,6 +382,7 @@ void animateTask(sf::RenderWindow &window,
                  AVLTree<int>& tree,
                  const vector<AVLNode<int>*>& searchPath = {})
 {
+    ScopedTimer timer(animateTaskStat);
     sf::Clock clock;
     while (clock.getElapsedTime().asSeconds() < duration) {
         sf::Event event;
@@ -291,9 +395,7 @@ void animateTask(sf::RenderWindow &window,
         window.clear(sf::Color::Black);
 
         // Draw the tree, highlighting the given searchPath (if any).
-        drawTree(window, tree.getRoot(),
-                 window.getSize().x / 2.f, 50.f,
-                 300.f, searchPath);
+        drawView(window, tree, searchPath);
 
         // Draw the message in the bottom-left corner.
         sf::Text taskText;
@@ -303,9 +405,9 @@ void animateTask(sf::RenderWindow &window,
         taskText.setFillColor(sf::Color::White);
         taskText.setStyle(sf::Text::Bold);
         taskText.setPosition(10.f, window.getSize().y - 50.f);
-        window.draw(taskText);
+        countedDraw(window, taskText);
 
-        window.display();
+        presentFrame(window, tree);
     }
 }
 
@@ -322,6 +424,7 @@ int main() {
     int insertionIndex = 0;
 
     AVLTree<int> avl;
+    avl.setVisitCounting(true); // feeds the heatmap
 
     // Load the font for drawing
     if (!globalFont.loadFromFile("ArialTh.ttf")) {
@@ -363,6 +466,29 @@ int main() {
                 window.close();
             }
 
+            // F1 shows/hides the profiler overlay, F2 the access heatmap,
+            // F3 switches between the node view and the density view
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F1) {
+                showProfiler = !showProfiler;
+            }
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F2) {
+                showHeatmap = !showHeatmap;
+            }
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F3) {
+                showDensity = !showDensity;
+            }
+
+            // F4 replaces the tree with a million random keys
+            if (initialTreeComplete && event.type == sf::Event::KeyPressed
+                && event.key.code == sf::Keyboard::F4) {
+                vector<int> bulk(1000000);
+                for (int& k : bulk) {
+                    k = (rand() % 10000) * 1000 + rand() % 1000;
+                }
+                avl.bulkLoad(bulk);
+                showDensity = true;
+            }
+
             // Once the initial array is fully inserted, handle user input
             if (initialTreeComplete) {
                 if (event.type == sf::Event::MouseButtonPressed) {
@@ -396,7 +522,10 @@ int main() {
                         if (isTypingInsert && !userInputInsert.isEmpty()) {
                             int newVal = atoi(userInputInsert.toAnsiString().c_str());
                             animateTask(window, "Inserting " + std::to_string(newVal), 1.0f, avl);
-                            avl.insert(newVal);
+                            {
+                                ScopedTimer insertTimer(insertStat);
+                                avl.insert(newVal);
+                            }
                             userInputInsert.clear();
                         }
                         else if (isTypingSearch && !userInputSearch.isEmpty()) {
@@ -439,7 +568,10 @@ int main() {
             if (insertionClock.getElapsedTime().asSeconds() >= insertionDelay) {
                 std::string taskMsg = "Inserting " + std::to_string(elements[insertionIndex]);
                 animateTask(window, taskMsg, 1.0f, avl);
-                avl.insert(elements[insertionIndex]);
+                {
+                    ScopedTimer insertTimer(insertStat);
+                    avl.insert(elements[insertionIndex]);
+                }
 
                 insertionIndex++;
                 insertionClock.restart();
@@ -454,9 +586,7 @@ int main() {
         window.clear(sf::Color::Black);
 
         // Always draw the tree (with no special path highlight by default).
-        drawTree(window, avl.getRoot(),
-                 window.getSize().x / 2.f, 50.f,
-                 300.f, {});
+        drawView(window, avl, {});
 
         // If the tree is complete, allow user to see the text boxes
         if (initialTreeComplete) {
@@ -468,7 +598,7 @@ int main() {
             insertBox.setFillColor(isTypingInsert
                                    ? sf::Color(50, 50, 200)
                                    : sf::Color(100, 100, 100));
-            window.draw(insertBox);
+            countedDraw(window, insertBox);
 
             sf::Text insertText;
             insertText.setFont(globalFont);
@@ -476,7 +606,7 @@ int main() {
             insertText.setCharacterSize(24);
             insertText.setFillColor(sf::Color::White);
             insertText.setPosition((float)insRect.left + 5, (float)insRect.top + 10);
-            window.draw(insertText);
+            countedDraw(window, insertText);
 
             // Search box
             sf::RectangleShape searchBox;
@@ -486,7 +616,7 @@ int main() {
             searchBox.setFillColor(isTypingSearch
                                    ? sf::Color(50, 50, 200)
                                    : sf::Color(100, 100, 100));
-            window.draw(searchBox);
+            countedDraw(window, searchBox);
 
             sf::Text searchText;
             searchText.setFont(globalFont);
@@ -494,10 +624,10 @@ int main() {
             searchText.setCharacterSize(24);
             searchText.setFillColor(sf::Color::White);
             searchText.setPosition((float)seaRect.left + 5, (float)seaRect.top + 10);
-            window.draw(searchText);
+            countedDraw(window, searchText);
         }
 
-        window.display();
+        presentFrame(window, avl);
     }
 
     return 0;
@@ -0,0 +1,156 @@
+// Checkpoint chains against std::set: random writes between deltas,
+// compaction, and recovery from a chain with a corrupt or torn delta
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../AVLTree.h"
+#include "../Checkpoint.h"
+#include "TestUtil.h"
+
+// Next to the test binary: "<binary>.data.base", "<binary>.data.delta.1", ...
+static std::string kPath;
+
+static bool exists(const std::string& name) {
+    std::FILE* f = std::fopen(name.c_str(), "rb");
+    if (f) {
+        std::fclose(f);
+    }
+    return f != nullptr;
+}
+
+static void randomWrites(AVLTree<int>& tree, std::set<int>& ref, std::mt19937& rng, int count) {
+    for (int i = 0; i < count; i++) {
+        int key = (int)(rng() % 20000);
+        if (rng() % 3 == 0) {
+            tree.remove(key);
+            ref.erase(key);
+        } else {
+            tree.insert(key);
+            ref.insert(key);
+        }
+    }
+}
+
+static bool recoversTo(const std::set<int>& ref) {
+    Checkpointer<int> cp(kPath, 64);
+    AVLTree<int> tree;
+    return cp.recover(tree) && tree.liveKeys() == std::vector<int>(ref.begin(), ref.end());
+}
+
+int main(int, char** argv) {
+    kPath = std::string(argv[0]) + ".data";
+    std::mt19937 rng(3);
+
+    // Deltas, compactions and recoveries in random order
+    {
+        Checkpointer<int> cp(kPath, 64);
+        AVLTree<int> tree;
+        std::set<int> ref;
+        randomWrites(tree, ref, rng, 3000);
+        CHECK(cp.writeBase(tree));
+        tree.setCheckpointer(&cp);
+        for (int round = 0; round < 40; round++) {
+            randomWrites(tree, ref, rng, (int)(rng() % 200));
+            CHECK(cp.writeDelta(tree) >= 0);
+            if (rng() % 8 == 0) {
+                CHECK(cp.compact());
+            }
+            CHECK(recoversTo(ref));
+        }
+        tree.setCheckpointer(nullptr);
+    }
+
+    // A corrupt delta ends the chain, and the deltas after it must not
+    // come back behind the ones written after recovery
+    {
+        Checkpointer<int> cp(kPath, 64);
+        AVLTree<int> tree;
+        std::set<int> ref;
+        randomWrites(tree, ref, rng, 3000);
+        CHECK(cp.writeBase(tree));
+        tree.setCheckpointer(&cp);
+        std::set<int> afterFirst;
+        for (int d = 1; d <= 4; d++) {
+            randomWrites(tree, ref, rng, 300);
+            CHECK(cp.writeDelta(tree) > 0);
+            if (d == 1) {
+                afterFirst = ref;
+            }
+        }
+        tree.setCheckpointer(nullptr);
+
+        std::FILE* f = std::fopen((kPath + ".delta.2").c_str(), "r+b");
+        CHECK(f != nullptr);
+        if (f) {
+            std::fputs("garbage!", f);
+            std::fclose(f);
+        }
+
+        Checkpointer<int> again(kPath, 64);
+        AVLTree<int> recovered;
+        std::set<int> refRecovered = afterFirst;
+        CHECK(again.recover(recovered));
+        CHECK(recovered.liveKeys() == std::vector<int>(afterFirst.begin(), afterFirst.end()));
+        CHECK(again.deltaCount() == 1);
+        CHECK(!exists(kPath + ".delta.2") && !exists(kPath + ".delta.4"));
+
+        recovered.setCheckpointer(&again);
+        randomWrites(recovered, refRecovered, rng, 50);
+        CHECK(again.writeDelta(recovered) > 0);
+        recovered.setCheckpointer(nullptr);
+        CHECK(recoversTo(refRecovered));
+    }
+
+    // A delta whose keys were cut short, and one whose chunk count is
+    // garbage, end the chain; recovery keeps the base and the deltas
+    // before them
+    for (int damage = 0; damage < 2; damage++) {
+        Checkpointer<int> cp(kPath, 64);
+        AVLTree<int> tree;
+        std::set<int> ref;
+        randomWrites(tree, ref, rng, 3000);
+        CHECK(cp.writeBase(tree));
+        tree.setCheckpointer(&cp);
+        std::set<int> beforeLast;
+        for (int d = 1; d <= 3; d++) {
+            if (d == 3) {
+                beforeLast = ref;
+            }
+            randomWrites(tree, ref, rng, 300);
+            CHECK(cp.writeDelta(tree) > 0);
+        }
+        tree.setCheckpointer(nullptr);
+
+        std::string last = kPath + ".delta.3";
+        if (damage == 0) {
+            std::filesystem::resize_file(last, std::filesystem::file_size(last) - 3);
+        } else {
+            std::FILE* f = std::fopen(last.c_str(), "r+b");
+            CHECK(f != nullptr);
+            if (f) {
+                uint64_t count = ~0ull / 2;
+                std::fseek(f, (long)offsetof(CheckpointFileHeader, chunkCount), SEEK_SET);
+                std::fwrite(&count, sizeof(count), 1, f);
+                std::fclose(f);
+            }
+        }
+
+        Checkpointer<int> again(kPath, 64);
+        AVLTree<int> recovered;
+        CHECK(again.recover(recovered));
+        CHECK(recovered.liveKeys() == std::vector<int>(beforeLast.begin(), beforeLast.end()));
+        CHECK(again.deltaCount() == 2);
+        CHECK(!exists(last));
+    }
+
+    std::remove((kPath + ".base").c_str());
+    for (int d = 1; d <= 64; d++) {
+        std::remove((kPath + ".delta." + std::to_string(d)).c_str());
+    }
+    return testExitCode("CheckpointTest");
+}
@@ -0,0 +1,172 @@
+// Copies, clones and moves against std::set: the two sides of a clone
+// diverge independently, visit counters are not shared, moved-from
+// trees are empty and usable, and either side can be destroyed first
+#include <memory>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "../AVLTree.h"
+#include "TestUtil.h"
+
+template <typename Fn>
+static void walk(const AVLNode<int>* node, Fn fn) {
+    if (node) {
+        walk(node->left, fn);
+        fn(node);
+        walk(node->right, fn);
+    }
+}
+
+static unsigned totalVisits(const AVLNode<int>* node) {
+    unsigned total = 0;
+    walk(node, [&](const AVLNode<int>* n) { total += n->visits.load() + n->hits.load(); });
+    return total;
+}
+
+template <typename Tree>
+static bool same(Tree& tree, const std::set<int>& ref) {
+    if (tree.size() != ref.size() || tree.liveKeys() != std::vector<int>(ref.begin(), ref.end())) {
+        return false;
+    }
+    for (int key = -1; key <= 4001; key += 7) {
+        if (tree.search(key) != (ref.count(key) != 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename Tree>
+static void randomWrites(Tree& tree, std::set<int>& ref, std::mt19937& rng, int count) {
+    for (int i = 0; i < count; i++) {
+        int key = (int)(rng() % 4000);
+        if (rng() % 3 == 0) {
+            tree.remove(key);
+            ref.erase(key);
+        } else {
+            tree.insert(key);
+            ref.insert(key);
+        }
+    }
+}
+
+// Clones of clones written in random order, then destroyed in random
+// order; every survivor must still match its reference
+template <typename Tree>
+static void cloneTree(std::mt19937& rng, bool tombstones) {
+    std::vector<std::unique_ptr<Tree>> trees;
+    std::vector<std::set<int>> refs;
+    trees.emplace_back(new Tree());
+    refs.emplace_back();
+    if (tombstones) {
+        trees[0]->setTombstones(0.25);
+    }
+    randomWrites(*trees[0], refs[0], rng, 2000);
+
+    for (int round = 0; round < 60; round++) {
+        size_t from = rng() % trees.size();
+        switch (rng() % 4) {
+        case 0:
+            trees.emplace_back(new Tree(trees[from]->clone()));
+            refs.push_back(refs[from]);
+            break;
+        case 1:
+            if (trees.size() > 1) {
+                trees.erase(trees.begin() + (long)from);
+                refs.erase(refs.begin() + (long)from);
+            }
+            break;
+        default:
+            randomWrites(*trees[from], refs[from], rng, (int)(rng() % 50));
+            break;
+        }
+        for (size_t t = 0; t < trees.size(); t++) {
+            CHECK(same(*trees[t], refs[t]));
+        }
+    }
+}
+
+int main() {
+    std::mt19937 rng(17);
+
+    cloneTree<AVLTree<int>>(rng, false);
+    cloneTree<AVLTree<int>>(rng, true);
+    cloneTree<AVLTree<int, avl_policy::SortedVector, avl_policy::PointerNodes,
+                      avl_policy::Lazy>>(rng, false);
+    cloneTree<AVLTree<int, avl_policy::SortedVector, avl_policy::PointerNodes,
+                      avl_policy::Incremental<16>>>(rng, false);
+
+    // Counting searches on one side of a clone leave the other's
+    // counters alone, in both directions
+    for (int tombstones = 0; tombstones < 2; tombstones++) {
+        AVLTree<int> tree;
+        if (tombstones) {
+            tree.setTombstones(0.5);
+        }
+        for (int key = 0; key < 500; key++) {
+            tree.insert(key);
+        }
+        if (tombstones) {
+            tree.remove(7);
+        }
+        tree.setVisitCounting(true);
+        for (int i = 0; i < 100; i++) {
+            tree.search(250);
+        }
+        unsigned before = totalVisits(tree.getRoot());
+
+        AVLTree<int> copy = tree.clone();
+        CHECK(totalVisits(copy.getRoot()) == before);
+        for (int i = 0; i < 100; i++) {
+            copy.search(i);
+            copy.getSearchPath(i + 100);
+        }
+        CHECK(totalVisits(tree.getRoot()) == before);
+        CHECK(totalVisits(copy.getRoot()) > before);
+        unsigned copyVisits = totalVisits(copy.getRoot());
+
+        for (int i = 0; i < 100; i++) {
+            tree.search(400);
+        }
+        CHECK(totalVisits(copy.getRoot()) == copyVisits);
+        tree.resetVisits();
+        CHECK(totalVisits(tree.getRoot()) == 0);
+        CHECK(totalVisits(copy.getRoot()) == copyVisits);
+
+        // The hits carried over to the copy's own nodes
+        walk(copy.getRoot(), [&](const AVLNode<int>* node) {
+            if (node->key == 250) {
+                CHECK(node->hits.load() == 100);
+            }
+        });
+    }
+
+    // Moves steal the storage and leave an empty, usable tree; a clone
+    // of the moved tree keeps working
+    {
+        std::set<int> ref;
+        AVLTree<int> a;
+        randomWrites(a, ref, rng, 1000);
+        AVLTree<int> shared = a.clone();
+        AVLTree<int> b(std::move(a));
+        CHECK(a.size() == 0 && a.getRoot() == nullptr && !a.search(*ref.begin()));
+        CHECK(same(b, ref));
+        CHECK(same(shared, ref));
+
+        AVLTree<int> c;
+        c.insert(-5);
+        c = std::move(b);
+        CHECK(b.size() == 0 && same(c, ref));
+
+        std::set<int> refA;
+        randomWrites(a, refA, rng, 300);
+        CHECK(same(a, refA));
+        c = a;
+        CHECK(same(c, refA) && same(a, refA));
+        randomWrites(c, refA, rng, 300);
+        CHECK(same(shared, ref));
+    }
+
+    return testExitCode("CloneTest");
+}
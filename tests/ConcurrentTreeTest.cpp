@@ -0,0 +1,90 @@
+// ConcurrentAVLTree under several writers and a reader: each writer
+// owns the keys congruent to its id, so its own reads are exact and
+// the final set can be replayed sequentially against std::set
+#include <atomic>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "../ConcurrentTree.h"
+#include "TestUtil.h"
+
+static const int kWriters = 4;
+static const int kSteps = 3000;
+
+// The writes of writer "id", in order; "apply" sees (key, insert?)
+template <typename Fn>
+static void writerOps(int id, Fn apply) {
+    std::mt19937 rng(id);
+    for (int i = 0; i < kSteps; i++) {
+        int key = i * kWriters + id;   // ascending: the worst case for the shape
+        apply(key, true);
+        if (rng() % 4 == 0) {
+            apply(key, false);
+        }
+        if (rng() % 16 == 0) {
+            apply((int)(rng() % (i + 1)) * kWriters + id, true);
+        }
+    }
+}
+
+int main() {
+    ConcurrentAVLTree<int> tree;
+    std::atomic<int> failures{0};
+    std::vector<std::thread> writers;
+    for (int id = 0; id < kWriters; id++) {
+        writers.emplace_back([&, id] {
+            writerOps(id, [&](int key, bool insert) {
+                if (insert) {
+                    tree.insert(key);
+                } else {
+                    tree.remove(key);
+                }
+                if (tree.search(key) != insert) {
+                    failures++;
+                }
+            });
+        });
+    }
+    std::atomic<bool> stop{false};
+    std::thread reader([&] {
+        std::mt19937 rng(99);
+        while (!stop) {
+            tree.search((int)(rng() % (kWriters * kSteps)));
+        }
+    });
+    for (auto& w : writers) {
+        w.join();
+    }
+    stop = true;
+    reader.join();
+    CHECK(failures == 0);
+
+    std::set<int> ref;
+    for (int id = 0; id < kWriters; id++) {
+        writerOps(id, [&](int key, bool insert) {
+            if (insert) {
+                ref.insert(key);
+            } else {
+                ref.erase(key);
+            }
+        });
+    }
+    CHECK(tree.getSortedElements() == std::vector<int>(ref.begin(), ref.end()));
+    CHECK(tree.size() == ref.size());
+
+    // Retired nodes are freed along the way: with one writer, at most
+    // the reclaim limit plus the one rebuild that crossed it
+    for (int key = kWriters * kSteps; key < kWriters * kSteps + 20000; key++) {
+        tree.insert(key);
+        size_t nodes = tree.size() + ref.size();  // bounds the dead nodes too
+        CHECK(tree.retiredNodes() <= 1024 + nodes);
+    }
+
+    for (int key = 0; key < kWriters * kSteps + 20000; key++) {
+        tree.remove(key);
+    }
+    CHECK(tree.size() == 0 && tree.getSortedElements().empty());
+    return testExitCode("ConcurrentTreeTest");
+}
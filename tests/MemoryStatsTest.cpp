@@ -0,0 +1,133 @@
+// memoryStats against sizes and write amplification worked out by hand:
+// after a bulk load, single inserts and removes, with successor links,
+// tombstones and deltas, and across clones, whose shared storage must
+// be countable once
+#include <algorithm>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "../AVLTree.h"
+#include "TestUtil.h"
+
+static const size_t kNode = sizeof(AVLNode<int>);
+
+int main() {
+    std::mt19937 rng(11);
+
+    // Bulk load with duplicates: one node per distinct key, nothing
+    // shifted, nothing shared
+    AVLTree<int> tree;
+    std::vector<int> keys;
+    for (int i = 0; i < 3000; i++) {
+        keys.push_back(2 * (int)(rng() % 2000));
+    }
+    tree.bulkLoad(keys);
+    std::set<int> ref(keys.begin(), keys.end());
+    size_t n = ref.size();
+    AVLMemoryStats s = tree.memoryStats();
+    CHECK(s.elementBytes == n * sizeof(int));
+    CHECK(s.elementCapacityBytes >= s.elementBytes);
+    CHECK(s.liveNodes == n && s.liveNodeBytes == n * kNode);
+    CHECK(s.nodesAllocated == n && s.elementsShifted == 0);
+    CHECK(s.leakedNodes == 0 && s.pendingReclaimNodes == 0 && s.sharedBytes == 0);
+    CHECK(s.deltaEntries == 0 && s.deadKeys == 0 && s.weightedNodes == 0);
+
+    // Inserts and removes inside the range shift the keys after the
+    // position and rebuild every node; a remove rebuilds even when the
+    // key is absent
+    unsigned long long allocated = s.nodesAllocated;
+    unsigned long long shifted = 0;
+    for (int i = 0; i < 50; i++) {
+        int key = 2 * (int)(rng() % 2000) + (i % 2);
+        bool present = ref.count(key) != 0;
+        size_t pos = (size_t)std::distance(ref.begin(), ref.lower_bound(key));
+        if (i % 3 == 0) {
+            tree.remove(key);
+            if (present) {
+                ref.erase(key);
+                shifted += ref.size() - pos;
+            }
+            allocated += ref.size();
+        } else if (!present && key < *ref.rbegin()) {
+            tree.insert(key);
+            ref.insert(key);
+            shifted += ref.size() - 1 - pos;
+            allocated += ref.size();
+        }
+    }
+    s = tree.memoryStats();
+    n = ref.size();
+    CHECK(s.elementBytes == n * sizeof(int));
+    CHECK(s.liveNodes == n && s.liveNodeBytes == n * kNode);
+    CHECK(s.nodesAllocated == allocated && s.elementsShifted == shifted);
+
+    // A clone shares both: it reports the same bytes, all of them
+    // shared, and none of the original's amplification
+    {
+        AVLTree<int> copy = tree.clone();
+        AVLMemoryStats a = tree.memoryStats();
+        AVLMemoryStats b = copy.memoryStats();
+        size_t own = a.elementCapacityBytes + a.liveNodeBytes;
+        CHECK(b.elementCapacityBytes + b.liveNodeBytes == own);
+        CHECK(a.sharedBytes == own && b.sharedBytes == own);
+        CHECK(a.nodesAllocated == allocated && b.nodesAllocated == 0 && b.elementsShifted == 0);
+        // Counting shared bytes once gives the storage of one tree
+        CHECK(a.elementCapacityBytes + a.liveNodeBytes + b.elementCapacityBytes
+                  + b.liveNodeBytes - a.sharedBytes == own);
+
+        // The first write gives the copy its own keys and nodes; the
+        // old nodes are still the original's live ones
+        int key = 1;
+        copy.insert(key);
+        a = tree.memoryStats();
+        b = copy.memoryStats();
+        CHECK(a.sharedBytes == 0 && b.sharedBytes == 0);
+        CHECK(b.liveNodes == n + 1 && b.nodesAllocated == n + 1);
+        CHECK(b.pendingReclaimNodes == a.liveNodes);
+        CHECK(a.liveNodes == n && a.nodesAllocated == allocated);
+    }
+    // With the copy gone, nothing is kept alive for it
+    CHECK(tree.memoryStats().sharedBytes == 0 && tree.memoryStats().pendingReclaimNodes == 0);
+
+    // Successor links add one pointer per node
+    tree.setSuccessorLinks(true);
+    s = tree.memoryStats();
+    CHECK(s.liveNodeBytes == n * (kNode + sizeof(AVLNode<int>*)));
+    tree.setSuccessorLinks(false);
+
+    // Tombstones keep their keys and nodes until compaction
+    tree.setTombstones(0.5);
+    std::vector<int> live(ref.begin(), ref.end());
+    for (size_t i = 0; i < 10; i++) {
+        tree.remove(live[i * 7]);
+    }
+    s = tree.memoryStats();
+    CHECK(s.deadKeys == 10 && s.liveNodes == n && s.elementBytes == n * sizeof(int));
+    tree.setTombstones(0);
+    s = tree.memoryStats();
+    CHECK(s.deadKeys == 0 && s.liveNodes == n - 10 && s.elementBytes == (n - 10) * sizeof(int));
+
+    // Incremental rebuilds hold writes in the delta until they are built
+    AVLTree<int, avl_policy::SortedVector, avl_policy::PointerNodes,
+            avl_policy::Incremental<4>> incremental;
+    incremental.bulkLoad(keys);
+    incremental.insert(1);
+    incremental.insert(3);
+    CHECK(incremental.memoryStats().deltaEntries > 0);
+    incremental.flushRebuild();
+    s = incremental.memoryStats();
+    CHECK(s.deltaEntries == 0 && s.liveNodes == incremental.size());
+
+    // The Eytzinger layout stores a key and a used flag per slot
+    AVLTree<int, avl_policy::SortedVector, avl_policy::Eytzinger> eytzinger;
+    eytzinger.bulkLoad(keys);
+    s = eytzinger.memoryStats();
+    CHECK(s.liveNodeBytes >= eytzinger.size() * (sizeof(int) + 1));
+    CHECK(s.liveNodeBytes < 2 * eytzinger.size() * (sizeof(int) + 1) + sizeof(int) + 1);
+    AVLTree<int, avl_policy::SortedVector, avl_policy::Eytzinger> eytzingerCopy = eytzinger;
+    CHECK(eytzingerCopy.memoryStats().sharedBytes
+          == s.elementCapacityBytes + s.liveNodeBytes);
+
+    return testExitCode("MemoryStatsTest");
+}
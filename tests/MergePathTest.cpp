@@ -0,0 +1,156 @@
+// Merge-path partitioned set operations and parallel tree builds
+// against the single-threaded versions and std::set, and the split
+// points themselves against a plain merge
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "../AVLTree.h"
+#include "../MergePath.h"
+#include "TestUtil.h"
+
+static std::vector<int> randomKeys(std::mt19937& rng, size_t n, int range) {
+    std::vector<int> v(n);
+    for (int& x : v) {
+        x = (int)(rng() % range);
+    }
+    return v;
+}
+
+static std::vector<int> sortedUnique(std::vector<int> v) {
+    std::sort(v.begin(), v.end());
+    v.erase(std::unique(v.begin(), v.end()), v.end());
+    return v;
+}
+
+static bool sameShape(const AVLNode<int>* x, const AVLNode<int>* y) {
+    if (!x || !y) {
+        return x == y;
+    }
+    return x->key == y->key && sameShape(x->left, y->left) && sameShape(x->right, y->right);
+}
+
+int main() {
+    std::mt19937 rng(7);
+
+    // Every diagonal of small inputs with runs of equal keys, against
+    // a stable merge that tags each output with its input
+    for (int round = 0; round < 300; round++) {
+        std::vector<int> a = randomKeys(rng, rng() % 12, 6);
+        std::vector<int> b = randomKeys(rng, rng() % 12, 6);
+        std::sort(a.begin(), a.end());
+        std::sort(b.begin(), b.end());
+        std::vector<std::pair<int, int>> ta, tb, merged;
+        for (int key : a) {
+            ta.push_back({key, 0});
+        }
+        for (int key : b) {
+            tb.push_back({key, 1});
+        }
+        std::merge(ta.begin(), ta.end(), tb.begin(), tb.end(), std::back_inserter(merged),
+                   [](const std::pair<int, int>& x, const std::pair<int, int>& y) {
+                       return x.first < y.first;
+                   });
+        size_t fromA = 0;
+        for (size_t diag = 0; diag <= merged.size(); diag++) {
+            CHECK(mergePathSplit(a.data(), a.size(), b.data(), b.size(), diag,
+                                 std::less<int>()) == fromA);
+            if (diag < merged.size()) {
+                fromA += merged[diag].second == 0;
+            }
+        }
+    }
+
+    // Threads only for pieces of at least kMergePathMinPiece
+    CHECK(mergePathThreads(4, 0) == 1);
+    CHECK(mergePathThreads(4, 2 * kMergePathMinPiece - 1) == 1);
+    CHECK(mergePathThreads(4, 2 * kMergePathMinPiece) == 2);
+    CHECK(mergePathThreads(4, 3 * kMergePathMinPiece) == 3);
+    CHECK(mergePathThreads(4, 100 * kMergePathMinPiece) == 4);
+    CHECK(mergePathThreads(1, 100 * kMergePathMinPiece) == 1);
+    CHECK(mergePathThreads(0, 1) == 1);
+
+    // Every split lands between twins: identical inputs, and inputs
+    // sharing every other key, at sizes just around the thread cutoffs
+    for (size_t n : {kMergePathMinPiece, kMergePathMinPiece + 1, 3 * kMergePathMinPiece / 2 + 7}) {
+        std::vector<int> a(n), b(n);
+        for (size_t i = 0; i < n; i++) {
+            a[i] = (int)(2 * i);
+            b[i] = (int)(i % 2 == 0 ? 2 * i : 2 * i + 1);
+        }
+        for (const std::vector<int>* other : {&a, &b}) {
+            std::vector<int> unionRef, differenceRef;
+            std::set_union(a.begin(), a.end(), other->begin(), other->end(),
+                           std::back_inserter(unionRef));
+            std::set_difference(a.begin(), a.end(), other->begin(), other->end(),
+                                std::back_inserter(differenceRef));
+            for (unsigned threads : {2u, 3u, 5u}) {
+                std::vector<int> out(2 * n);
+                out.resize(parallelSetUnion(a.data(), n, other->data(), n, out.data(), threads,
+                                            std::less<int>()));
+                CHECK(out == unionRef);
+                out.assign(n, 0);
+                out.resize(parallelSetDifference(a.data(), n, other->data(), n, out.data(),
+                                                 threads, std::less<int>()));
+                CHECK(out == differenceRef);
+            }
+        }
+    }
+
+    // Inputs large enough to split into several kMergePathMinPiece
+    // pieces, with one side much shorter in some rounds
+    const size_t sizes[][2] = {{300000, 200000}, {400000, 1000}, {1000, 400000}, {0, 200000}};
+    for (const auto& size : sizes) {
+        std::vector<int> a = sortedUnique(randomKeys(rng, size[0], 1000000));
+        std::vector<int> b = sortedUnique(randomKeys(rng, size[1], 1000000));
+        std::vector<int> unionRef, differenceRef;
+        std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(unionRef));
+        std::set_difference(a.begin(), a.end(), b.begin(), b.end(),
+                            std::back_inserter(differenceRef));
+        for (unsigned threads : {1u, 2u, 3u, 7u}) {
+            std::vector<int> out(a.size() + b.size());
+            out.resize(parallelSetUnion(a.data(), a.size(), b.data(), b.size(), out.data(),
+                                        threads, std::less<int>()));
+            CHECK(out == unionRef);
+            out.assign(a.size(), 0);
+            out.resize(parallelSetDifference(a.data(), a.size(), b.data(), b.size(), out.data(),
+                                             threads, std::less<int>()));
+            CHECK(out == differenceRef);
+        }
+    }
+
+    // Batches on a parallel tree give the keys and the node layout of
+    // a single-threaded one
+    for (NodeOrder order : {NodeOrder::InOrder, NodeOrder::BreadthFirst, NodeOrder::VanEmdeBoas}) {
+        AVLTree<int> serial, parallel, other;
+        serial.setNodeOrder(order);
+        parallel.setNodeOrder(order);
+        parallel.setParallelism(4);
+        std::set<int> ref;
+        for (int round = 0; round < 4; round++) {
+            std::vector<int> batch = randomKeys(rng, 150000, 2000000);
+            if (round % 2 == 0) {
+                serial.insertBatch(batch);
+                parallel.insertBatch(batch);
+                ref.insert(batch.begin(), batch.end());
+            } else {
+                serial.removeBatch(batch);
+                parallel.removeBatch(batch);
+                for (int key : batch) {
+                    ref.erase(key);
+                }
+            }
+            CHECK(parallel.liveKeys() == std::vector<int>(ref.begin(), ref.end()));
+            CHECK(sameShape(serial.getRoot(), parallel.getRoot()));
+        }
+        other.bulkLoad(randomKeys(rng, 150000, 2000000));
+        serial.unionWith(other);
+        parallel.unionWith(other);
+        CHECK(serial.liveKeys() == parallel.liveKeys());
+        CHECK(sameShape(serial.getRoot(), parallel.getRoot()));
+    }
+    return testExitCode("MergePathTest");
+}
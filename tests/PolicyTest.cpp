@@ -0,0 +1,57 @@
+// Every rebuild policy and layout, with tombstones and run-time
+// incremental rebuilds, against std::set on random writes and reads
+#include <random>
+#include <set>
+#include <vector>
+
+#include "../AVLTree.h"
+#include "TestUtil.h"
+
+using namespace avl_policy;
+
+template <typename Tree, typename Setup>
+static void differential(unsigned seed, int range, Setup setup) {
+    std::mt19937 rng(seed);
+    Tree tree;
+    setup(tree);
+    std::set<int> ref;
+    for (int i = 0; i < 3000; i++) {
+        int key = (int)(rng() % range);
+        switch (rng() % 4) {
+        case 0:
+            tree.remove(key);
+            ref.erase(key);
+            break;
+        case 1:
+            tree.insert(key);
+            ref.insert(key);
+            break;
+        default:
+            CHECK(tree.search(key) == (ref.count(key) > 0));
+        }
+        CHECK(tree.size() == ref.size());
+    }
+    CHECK(tree.liveKeys() == std::vector<int>(ref.begin(), ref.end()));
+    tree.flushRebuild();
+    for (int key = -1; key <= range; key++) {
+        CHECK(tree.search(key) == (ref.count(key) > 0));
+    }
+}
+
+int main() {
+    auto none = [](auto&) {};
+    for (int range : {16, 500}) {
+        differential<AVLTree<int>>(1, range, none);
+        differential<AVLTree<int, SortedVector, PointerNodes, Lazy>>(2, range, none);
+        differential<AVLTree<int, SortedVector, PointerNodes, Incremental<8>>>(3, range, none);
+        differential<AVLTree<int, SortedVector, Eytzinger, Eager>>(4, range, none);
+        differential<AVLTree<int, SortedVector, Eytzinger, Lazy>>(5, range, none);
+        differential<AVLTree<int>>(6, range, [](auto& t) { t.setIncrementalRebuild(8); });
+        differential<AVLTree<int>>(7, range, [](auto& t) { t.setTombstones(0.3); });
+        differential<AVLTree<int, SortedVector, PointerNodes, Lazy>>(
+            8, range, [](auto& t) { t.setTombstones(0.3); });
+        differential<AVLTree<int, SortedVector, PointerNodes, Incremental<8>>>(
+            9, range, [](auto& t) { t.setIncrementalRebuild(0); });
+    }
+    return testExitCode("PolicyTest");
+}
@@ -0,0 +1,75 @@
+// RoaringAVLTree against std::set: writes, rank/select, and union and
+// intersection across array, bitmap and run containers
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <set>
+
+#include "../Roaring.h"
+#include "TestUtil.h"
+
+// Keys in three high-16 buckets; "density" of 1/density of each one,
+// so dense buckets become bitmaps and sparse ones stay arrays
+static void fill(RoaringAVLTree& tree, std::set<uint32_t>& ref, std::mt19937& rng,
+                 unsigned density, unsigned count) {
+    for (unsigned i = 0; i < count; i++) {
+        uint32_t high = rng() % 3;
+        uint32_t key = (high << 16) | (rng() % (65536 / density));
+        tree.insert(key);
+        ref.insert(key);
+    }
+}
+
+static void checkSame(const RoaringAVLTree& tree, const std::set<uint32_t>& ref,
+                      std::mt19937& rng) {
+    CHECK(tree.size() == ref.size());
+    for (int i = 0; i < 2000; i++) {
+        uint32_t key = rng() % (4 << 16);
+        bool present = ref.count(key) > 0;
+        CHECK(tree.contains(key) == present);
+        CHECK(tree.search(key) == present);
+        uint64_t below = (uint64_t)std::distance(ref.begin(), ref.lower_bound(key));
+        CHECK(tree.rank(key) == below);
+        if (below < ref.size()) {
+            CHECK(tree.select(below) == *ref.lower_bound(key));
+        }
+    }
+}
+
+int main() {
+    std::mt19937 rng(9);
+    for (unsigned densityA : {1u, 8u, 64u}) {
+        for (unsigned densityB : {1u, 64u}) {
+            RoaringAVLTree a, b;
+            std::set<uint32_t> refA, refB;
+            fill(a, refA, rng, densityA, 30000);
+            fill(b, refB, rng, densityB, 30000);
+            for (int i = 0; i < 3000; i++) {
+                uint32_t key = rng() % (3 << 16);
+                a.remove(key);
+                refA.erase(key);
+            }
+            checkSame(a, refA, rng);
+            if (rng() % 2) {
+                a.runOptimize();
+                b.runOptimize();
+            }
+
+            RoaringAVLTree u = a;
+            u.unionWith(b);
+            std::set<uint32_t> refU = refA;
+            refU.insert(refB.begin(), refB.end());
+            checkSame(u, refU, rng);
+
+            RoaringAVLTree x = a;
+            x.intersectWith(b);
+            std::set<uint32_t> refX;
+            std::set_intersection(refA.begin(), refA.end(), refB.begin(), refB.end(),
+                                  std::inserter(refX, refX.end()));
+            checkSame(x, refX, rng);
+            CHECK(x.countRange(0, 1 << 16) ==
+                  (uint64_t)std::distance(refX.begin(), refX.lower_bound(1 << 16)));
+        }
+    }
+    return testExitCode("RoaringTest");
+}
@@ -0,0 +1,63 @@
+// Every search kernel against std::set, on random keys and on sizes
+// that end exactly on a 16-key block
+#include <random>
+#include <set>
+#include <vector>
+
+#include "../AVLTree.h"
+#include "TestUtil.h"
+
+static const SearchKernel kKernels[] = {SearchKernel::Pointer, SearchKernel::Eytzinger,
+                                        SearchKernel::Branchless, SearchKernel::KAry,
+                                        SearchKernel::BPlusTree};
+
+template <typename T>
+void checkIndex(const std::vector<T>& sorted, const std::vector<T>& queries, bool avx2) {
+    std::set<T> ref(sorted.begin(), sorted.end());
+    for (SearchKernel kernel : kKernels) {
+        SearchIndex<T> index(sorted, kernel, avx2);
+        for (const T& q : queries) {
+            CHECK(index.contains(sorted, q) == (ref.count(q) > 0));
+        }
+    }
+}
+
+int main() {
+    std::mt19937_64 rng(7);
+    bool avx2 = CpuInfo::detect().avx2;
+
+    // Block multiples: the padded upper level used to point past the
+    // leaves for a key above every key
+    for (long n : {0L, 1L, 15L, 16L, 17L, 32L, 256L, 272L, 4096L, 65536L}) {
+        std::vector<int> sorted(n);
+        for (long i = 0; i < n; i++) {
+            sorted[i] = (int)i;
+        }
+        std::vector<int> queries{-5, -1, 0, (int)n - 1, (int)n, (int)n + 1, 100, 1 << 30};
+        for (int i = 0; i < 200; i++) {
+            queries.push_back((int)(rng() % (uint64_t)(n + 10)) - 5);
+        }
+        for (bool simd : {false, avx2}) {
+            checkIndex(sorted, queries, simd);
+        }
+    }
+
+    // Random 64-bit keys, through AVLTree::search
+    for (int round = 0; round < 20; round++) {
+        std::set<int64_t> ref;
+        size_t n = (round % 4 == 0) ? 16 * (1 + rng() % 64) : rng() % 3000;
+        while (ref.size() < n) {
+            ref.insert((int64_t)(rng() % 100000) - 50000);
+        }
+        AVLTree<int64_t> tree;
+        tree.bulkLoad(std::vector<int64_t>(ref.begin(), ref.end()));
+        for (SearchKernel kernel : kKernels) {
+            tree.setSearchKernel(kernel);
+            for (int i = 0; i < 500; i++) {
+                int64_t q = (int64_t)(rng() % 120000) - 60000;
+                CHECK(tree.search(q) == (ref.count(q) > 0));
+            }
+        }
+    }
+    return testExitCode("SearchKernelsTest");
+}
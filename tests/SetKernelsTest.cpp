@@ -0,0 +1,149 @@
+// The set kernels against the std:: algorithms, for every key type
+// with an AVX2 version and for a comparator that takes the fallback;
+// on AVX2 machines the vector kernels are also called directly and
+// checked against the scalar path
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "../SetKernels.h"
+#include "TestUtil.h"
+
+template <typename T, typename Compare>
+static std::vector<T> randomRun(std::mt19937_64& rng, size_t n, uint64_t range, Compare comp) {
+    std::vector<T> v(n);
+    for (T& x : v) {
+        // Spread over negative values too, and reach the type's extremes
+        x = (T)(rng() % range);
+        if (std::is_signed<T>::value && rng() % 2) {
+            x = (T)(-x - 1);
+        }
+        if (rng() % 64 == 0) {
+            x = rng() % 2 ? std::numeric_limits<T>::max() : std::numeric_limits<T>::min();
+        }
+    }
+    std::sort(v.begin(), v.end(), comp);
+    return v;
+}
+
+template <typename T, typename Compare = std::less<T>>
+static void check(std::mt19937_64& rng, size_t na, size_t nb, uint64_t range,
+                  Compare comp = Compare()) {
+    std::vector<T> a = randomRun<T>(rng, na, range, comp);
+    std::vector<T> b = randomRun<T>(rng, nb, range, comp);
+    auto equal = [&](const T& x, const T& y) { return !comp(x, y) && !comp(y, x); };
+
+    std::vector<T> dedup = a;
+    dedup.resize(set_kernels::uniqueSorted(dedup.data(), dedup.size(), comp));
+    a.erase(std::unique(a.begin(), a.end(), equal), a.end());
+    b.erase(std::unique(b.begin(), b.end(), equal), b.end());
+    CHECK(dedup == a);
+
+    std::vector<T> ref;
+    std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(ref), comp);
+    std::vector<T> out(a.size() + b.size());
+    out.resize(set_kernels::setUnion(a.data(), a.size(), b.data(), b.size(),
+                                     out.data(), out.size(), comp));
+    CHECK(out == ref);
+
+    ref.clear();
+    std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(ref), comp);
+    out.assign(a.size(), T());
+    out.resize(set_kernels::setDifference(a.data(), a.size(), b.data(), b.size(),
+                                          out.data(), out.size(), comp));
+    CHECK(out == ref);
+
+    ref.clear();
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(ref), comp);
+    CHECK(set_kernels::intersectionSize(a.data(), a.size(), b.data(), b.size(), comp) == ref.size());
+}
+
+// The AVX2 kernels called directly against the scalar std:: path on
+// the same runs, with "room" exactly the result length and guard keys
+// after it that must stay untouched
+template <typename T>
+static void checkAvx2(std::mt19937_64& rng, size_t na, size_t nb, uint64_t range) {
+#ifdef SET_KERNELS_X86
+    std::less<T> comp;
+    std::vector<T> a = randomRun<T>(rng, na, range, comp);
+    std::vector<T> b = randomRun<T>(rng, nb, range, comp);
+    const size_t kGuard = 8;
+    const T guard = (T)0x5a5a5a5a;
+    auto guarded = [&](const std::vector<T>& out, const std::vector<T>& ref) {
+        return std::equal(ref.begin(), ref.end(), out.begin())
+               && std::count(out.begin() + (long)ref.size(), out.end(), guard) == (long)kGuard;
+    };
+
+    std::vector<T> simd = a;
+    simd.resize(set_kernels::detail::uniqueAvx2(simd.data(), simd.size()));
+    a.erase(std::unique(a.begin(), a.end()), a.end());
+    b.erase(std::unique(b.begin(), b.end()), b.end());
+    CHECK(simd == a);
+
+    std::vector<T> ref;
+    if constexpr (std::is_signed<T>::value) {
+        std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(ref));
+        simd.assign(ref.size() + kGuard, guard);
+        CHECK(set_kernels::detail::unionAvx2(a.data(), a.size(), b.data(), b.size(),
+                                             simd.data(), ref.size()) == ref.size());
+        CHECK(guarded(simd, ref));
+    }
+
+    ref.clear();
+    std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(ref));
+    simd.assign(ref.size() + kGuard, guard);
+    CHECK(set_kernels::detail::compareAvx2<true>(a.data(), a.size(), b.data(), b.size(),
+                                                 simd.data(), ref.size()) == ref.size());
+    CHECK(guarded(simd, ref));
+
+    ref.clear();
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(ref));
+    CHECK(set_kernels::detail::compareAvx2<false>(a.data(), a.size(), b.data(), b.size(),
+                                                  (T*)nullptr, 0) == ref.size());
+#else
+    (void)rng, (void)na, (void)nb, (void)range;
+#endif
+}
+
+int main() {
+    std::mt19937_64 rng(5);
+    // Short runs hit every tail length of the 4- and 8-lane loops
+    for (int i = 0; i < 2000; i++) {
+        size_t na = rng() % 70;
+        size_t nb = rng() % 70;
+        uint64_t range = 1 + rng() % 200;
+        check<int>(rng, na, nb, range);
+        check<long long>(rng, na, nb, range);
+        check<uint32_t>(rng, na, nb, range);
+        check<uint64_t>(rng, na, nb, range);
+        check<int>(rng, na, nb, range, std::greater<int>());
+    }
+    for (int i = 0; i < 3; i++) {
+        check<int>(rng, 100000, 70000, 1000000);
+        check<int64_t>(rng, 100000, 70000, 1ULL << 40);
+        check<int>(rng, 100000, 300, 1000000);
+        check<uint32_t>(rng, 300, 100000, 1000000);
+    }
+
+    if (set_kernels::hasAvx2()) {
+        for (int i = 0; i < 2000; i++) {
+            size_t na = rng() % 70;
+            size_t nb = rng() % 70;
+            uint64_t range = 1 + rng() % 200;
+            checkAvx2<int32_t>(rng, na, nb, range);
+            checkAvx2<int64_t>(rng, na, nb, range);
+            checkAvx2<uint32_t>(rng, na, nb, range);
+            checkAvx2<uint64_t>(rng, na, nb, range);
+        }
+        checkAvx2<int32_t>(rng, 100000, 70000, 1000000);
+        checkAvx2<int64_t>(rng, 70000, 100000, 1ULL << 40);
+    } else {
+        std::printf("SetKernelsTest: no AVX2, only the scalar path was checked\n");
+    }
+    return testExitCode("SetKernelsTest");
+}
@@ -0,0 +1,63 @@
+// depthOf, ancestorAt and lca, which compute on ranks alone, against a
+// walk of the real tree for every size up to 200: all keys, all pairs,
+// absent keys, and levels below a key's own depth
+#include <vector>
+
+#include "../AVLTree.h"
+#include "TestUtil.h"
+
+// paths[i] = keys from the root down to the i-th key in order
+static void walk(const AVLNode<int>* node, std::vector<int>& path,
+                 std::vector<std::vector<int>>& paths) {
+    if (!node) {
+        return;
+    }
+    path.push_back(node->key);
+    walk(node->left, path, paths);
+    paths.push_back(path);
+    walk(node->right, path, paths);
+    path.pop_back();
+}
+
+int main() {
+    // Even keys only, so every odd key is absent
+    AVLTree<int> tree;
+    for (int n = 1; n <= 200; n++) {
+        tree.insert(2 * (n - 1));
+        std::vector<int> path;
+        std::vector<std::vector<int>> paths;
+        walk(tree.getRoot(), path, paths);
+        CHECK(paths.size() == (size_t)n);
+
+        for (int i = 0; i < n; i++) {
+            int key = 2 * i;
+            const std::vector<int>& p = paths[i];
+            CHECK(p.back() == key);
+            int depth = (int)p.size() - 1;
+            CHECK(tree.depthOf(key) == depth);
+            CHECK(tree.ancestorAt(key, -1) == nullptr);
+            for (int level = 0; level <= depth + 2; level++) {
+                const int* a = tree.ancestorAt(key, level);
+                CHECK(level <= depth ? a && *a == p[level] : a == nullptr);
+            }
+            for (int j = 0; j < n; j++) {
+                const std::vector<int>& q = paths[j];
+                size_t common = 0;
+                while (common < p.size() && common < q.size() && p[common] == q[common]) {
+                    common++;
+                }
+                const int* l = tree.lca(key, 2 * j);
+                CHECK(l && *l == p[common - 1]);
+            }
+            CHECK(tree.lca(key, key + 1) == nullptr && tree.lca(key - 1, key) == nullptr);
+        }
+
+        for (int key = -1; key <= 2 * n; key += 2) {
+            CHECK(tree.depthOf(key) == -1);
+            CHECK(tree.ancestorAt(key, 0) == nullptr);
+            CHECK(tree.lca(key, key) == nullptr);
+        }
+        CHECK(tree.depthOf(2 * n) == -1);
+    }
+    return testExitCode("ShapeQueryTest");
+}
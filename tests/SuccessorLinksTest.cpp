@@ -0,0 +1,151 @@
+// Node scans over successor links against std::set, across node
+// orders, parallel builds, appends, tombstones and incremental rebuilds,
+// and the nodes they reach against an in-order walk of the tree
+#include <random>
+#include <set>
+#include <vector>
+
+#include "../AVLTree.h"
+#include "TestUtil.h"
+
+template <typename Tree>
+static std::vector<int> scan(Tree& tree, const int* lo, const int* hi) {
+    std::vector<int> keys;
+    tree.forEachNodeBetween(lo, hi, [&](AVLNode<int>* node) { keys.push_back(node->key); });
+    return keys;
+}
+
+static std::vector<int> expected(const std::set<int>& ref, const int* lo, const int* hi) {
+    auto first = lo ? ref.lower_bound(*lo) : ref.begin();
+    auto last = hi ? ref.lower_bound(*hi) : ref.end();
+    return (lo && hi && *hi <= *lo) ? std::vector<int>() : std::vector<int>(first, last);
+}
+
+static void inorder(AVLNode<int>* node, std::vector<AVLNode<int>*>& out) {
+    if (node) {
+        inorder(node->left, out);
+        out.push_back(node);
+        inorder(node->right, out);
+    }
+}
+
+// The links lead through the tree's own nodes: a scan from any key
+// visits, pointer for pointer, the live nodes of an in-order walk of
+// getRoot() from that key on, and stops after the last one
+template <typename Tree>
+static void checkLinks(Tree& tree, const std::set<int>& ref) {
+    std::vector<AVLNode<int>*> walk, live, scanned;
+    inorder(tree.getRoot(), walk);
+    for (AVLNode<int>* node : walk) {
+        if (ref.count(node->key)) {
+            live.push_back(node);
+        }
+    }
+    tree.forEachNodeBetween(nullptr, nullptr, [&](AVLNode<int>* node) { scanned.push_back(node); });
+    CHECK(scanned == live);
+    for (size_t i = 0; i < live.size(); i += 1 + live.size() / 50) {
+        scanned.clear();
+        tree.forEachNodeBetween(&live[i]->key, nullptr,
+                                [&](AVLNode<int>* node) { scanned.push_back(node); });
+        CHECK(scanned == std::vector<AVLNode<int>*>(live.begin() + (long)i, live.end()));
+    }
+}
+
+template <typename Tree>
+static void checkScans(Tree& tree, const std::set<int>& ref, std::mt19937& rng) {
+    checkLinks(tree, ref);
+    CHECK(scan(tree, nullptr, nullptr) == expected(ref, nullptr, nullptr));
+    for (int q = 0; q < 20; q++) {
+        int lo = (int)(rng() % 12000) - 1000;
+        int hi = lo + (int)(rng() % 3000);
+        CHECK(scan(tree, &lo, &hi) == expected(ref, &lo, &hi));
+        CHECK(scan(tree, &lo, nullptr) == expected(ref, &lo, nullptr));
+        CHECK(scan(tree, nullptr, &hi) == expected(ref, nullptr, &hi));
+    }
+}
+
+int main() {
+    std::mt19937 rng(3);
+    for (NodeOrder order : {NodeOrder::InOrder, NodeOrder::BreadthFirst, NodeOrder::VanEmdeBoas}) {
+        for (unsigned threads : {1u, 4u}) {
+            AVLTree<int> tree;
+            tree.setNodeOrder(order);
+            tree.setParallelism(threads);
+            tree.setSuccessorLinks(true);
+            std::set<int> ref;
+            checkScans(tree, ref, rng);
+
+            // Single inserts, including appends past the last key
+            for (int i = 0; i < 300; i++) {
+                int key = rng() % 3 == 0 ? 10000 + i : (int)(rng() % 10000);
+                tree.insert(key);
+                ref.insert(key);
+            }
+            checkScans(tree, ref, rng);
+
+            // Appends one by one: the old last node must link to the new one
+            for (int i = 0; i < 40; i++) {
+                int key = 20000 + i;
+                tree.insert(key);
+                ref.insert(key);
+                checkLinks(tree, ref);
+            }
+
+            // Batches, then tombstoned removes and re-inserts
+            std::vector<int> batch;
+            for (int i = 0; i < 3000; i++) {
+                batch.push_back((int)(rng() % 10000));
+            }
+            tree.insertBatch(batch);
+            ref.insert(batch.begin(), batch.end());
+            checkScans(tree, ref, rng);
+            tree.setTombstones(0.3);
+            for (int i = 0; i < 600; i++) {
+                int key = (int)(rng() % 10000);
+                if (rng() % 4 == 0) {
+                    tree.insert(key);
+                    ref.insert(key);
+                } else {
+                    tree.remove(key);
+                    ref.erase(key);
+                }
+            }
+            checkScans(tree, ref, rng);
+            tree.setTombstones(0);
+            checkScans(tree, ref, rng);
+
+            // Links can be turned off and on again
+            tree.setSuccessorLinks(false);
+            checkScans(tree, ref, rng);
+            tree.setSuccessorLinks(true);
+            checkScans(tree, ref, rng);
+
+            // A rebuild in another node order links the new nodes
+            tree.setNodeOrder(order == NodeOrder::InOrder ? NodeOrder::VanEmdeBoas
+                                                          : NodeOrder::InOrder);
+            checkLinks(tree, ref);
+        }
+    }
+
+    // Incremental rebuilds: the scan sees the current tree, so flush
+    // the delta first
+    AVLTree<int, avl_policy::SortedVector, avl_policy::PointerNodes,
+            avl_policy::Incremental<64>> incremental;
+    incremental.setSuccessorLinks(true);
+    std::set<int> ref;
+    for (int i = 0; i < 5000; i++) {
+        int key = (int)(rng() % 10000);
+        if (rng() % 3 == 0) {
+            incremental.remove(key);
+            ref.erase(key);
+        } else {
+            incremental.insert(key);
+            ref.insert(key);
+        }
+        if (i % 1000 == 999) {
+            incremental.flushRebuild();
+            checkScans(incremental, ref, rng);
+        }
+    }
+    return testExitCode("SuccessorLinksTest");
+}
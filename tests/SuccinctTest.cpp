@@ -0,0 +1,93 @@
+// SuccinctAVLTree (Elias-Fano) against std::set, on its own and when
+// converted from an AVLTree in each write mode
+#include <random>
+#include <set>
+#include <vector>
+
+#include "../EliasFano.h"
+#include "TestUtil.h"
+
+static void checkSame(const SuccinctAVLTree& succinct, const std::set<uint64_t>& ref,
+                      std::mt19937_64& rng, uint64_t range)
+{
+    CHECK(succinct.size() == ref.size());
+    for (uint64_t key : ref) {
+        CHECK(succinct.search(key));
+    }
+    for (int i = 0; i < 300; i++) {
+        uint64_t q = rng() % range;
+        CHECK(succinct.search(q) == (ref.count(q) > 0));
+    }
+}
+
+int main() {
+    std::mt19937_64 rng(11);
+
+    // Random writes, including keys near 2^64
+    for (uint64_t range : {64ULL, 100000ULL, ~0ULL}) {
+        SuccinctAVLTree succinct;
+        std::set<uint64_t> ref;
+        for (int i = 0; i < 400; i++) {
+            uint64_t key = rng() % range;
+            if (rng() % 3 == 0) {
+                succinct.remove(key);
+                ref.erase(key);
+            } else {
+                succinct.insert(key);
+                ref.insert(key);
+            }
+        }
+        checkSame(succinct, ref, rng, range);
+    }
+
+    // Conversion sees what search() sees: no tombstoned keys...
+    {
+        AVLTree<uint64_t> tree;
+        std::set<uint64_t> ref;
+        for (uint64_t key = 0; key < 200; key++) {
+            tree.insert(key);
+            ref.insert(key);
+        }
+        tree.setTombstones(0.5);
+        for (uint64_t key = 3; key < 200; key += 7) {
+            tree.remove(key);
+            ref.erase(key);
+        }
+        CHECK(!tree.search(3));
+        SuccinctAVLTree succinct(tree);
+        checkSame(succinct, ref, rng, 300);
+    }
+    // ...and the writes still in an incremental rebuild's delta, with
+    // the budget set at run time or by the policy
+    {
+        AVLTree<uint64_t> tree;
+        AVLTree<uint64_t, avl_policy::SortedVector, avl_policy::PointerNodes,
+                avl_policy::Incremental<4>> policyTree;
+        std::set<uint64_t> ref;
+        for (uint64_t key = 0; key < 10; key++) {
+            tree.insert(key);
+            policyTree.insert(key);
+            ref.insert(key);
+        }
+        tree.setIncrementalRebuild(4);
+        for (int i = 0; i < 300; i++) {
+            uint64_t key = rng() % 400;
+            if (rng() % 4 == 0) {
+                tree.remove(key);
+                policyTree.remove(key);
+                ref.erase(key);
+            } else {
+                tree.insert(key);
+                policyTree.insert(key);
+                ref.insert(key);
+            }
+        }
+        tree.insert(1000);
+        policyTree.insert(1000);
+        ref.insert(1000);
+        CHECK(tree.liveKeys() == std::vector<uint64_t>(ref.begin(), ref.end()));
+        checkSame(SuccinctAVLTree(tree), ref, rng, 1100);
+        checkSame(SuccinctAVLTree(policyTree), ref, rng, 1100);
+    }
+    return testExitCode("SuccinctTest");
+}
@@ -0,0 +1,35 @@
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include <cstdio>
+#include <cstdlib>
+
+// ----------------------------------------------------
+// Minimal checks for the differential tests: CHECK reports the
+// failing expression and keeps going, so one run lists every
+// mismatch; main() returns testExitCode().
+// ----------------------------------------------------
+inline int& testFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(cond)                                                          \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__,      \
+                         __LINE__, #cond);                                   \
+            testFailures()++;                                                \
+        }                                                                    \
+    } while (0)
+
+inline int testExitCode(const char* name) {
+    if (testFailures() == 0) {
+        std::printf("%s: ok\n", name);
+        return 0;
+    }
+    std::printf("%s: %d failed\n", name, testFailures());
+    return 1;
+}
+
+#endif // TEST_UTIL_H
@@ -0,0 +1,128 @@
+// Tombstoned removes against std::set: every read path must treat a
+// dead key as absent, before and after compaction, and compaction
+// must start exactly at the threshold
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "../AVLTree.h"
+#include "TestUtil.h"
+
+static void checkReads(AVLTree<int>& tree, const std::set<int>& ref) {
+    CHECK(tree.size() == ref.size());
+    CHECK(tree.liveKeys() == std::vector<int>(ref.begin(), ref.end()));
+    std::vector<int> queries;
+    for (int key = -2; key < 2002; key++) {
+        queries.push_back(key);
+    }
+    std::vector<char> found;
+    tree.searchSorted(queries.begin(), queries.end(), std::back_inserter(found));
+    auto cursor = tree.cursor();
+    for (size_t i = 0; i < queries.size(); i++) {
+        bool present = ref.count(queries[i]) > 0;
+        CHECK(tree.search(queries[i]) == present);
+        CHECK(tree.searchWeighted(queries[i]) == present);
+        CHECK(cursor.find(queries[i]) == present);
+        CHECK((found[i] != 0) == present);
+    }
+    int lo = 500, hi = 1500;
+    std::vector<int> inRange;
+    tree.forEachInRange(lo, hi, [&](int key) { inRange.push_back(key); });
+    CHECK(inRange == std::vector<int>(ref.lower_bound(lo), ref.lower_bound(hi)));
+}
+
+int main() {
+    std::mt19937 rng(13);
+    for (double threshold : {0.05, 0.25, 0.9}) {
+        AVLTree<int> tree;
+        std::set<int> ref;
+        std::vector<int> keys;
+        for (int i = 0; i < 1500; i++) {
+            keys.push_back((int)(rng() % 2000));
+        }
+        tree.bulkLoad(keys);
+        ref.insert(keys.begin(), keys.end());
+        tree.setTombstones(threshold);
+        tree.buildWeighted(std::vector<double>(tree.getSortedElements().size(), 1.0));
+        for (int round = 0; round < 6; round++) {
+            for (int i = 0; i < 150; i++) {
+                int key = (int)(rng() % 2000);
+                // Mostly removes, and re-inserts of keys that may be dead
+                if (rng() % 5 == 0) {
+                    tree.insert(key);
+                    ref.insert(key);
+                } else {
+                    tree.remove(key);
+                    ref.erase(key);
+                }
+            }
+            checkReads(tree, ref);
+        }
+        tree.flushRebuild();
+        CHECK(tree.getSortedElements() == std::vector<int>(ref.begin(), ref.end()));
+        checkReads(tree, ref);
+        tree.setTombstones(0);
+        checkReads(tree, ref);
+    }
+    // Compaction happens exactly when the dead keys exceed the
+    // threshold times the stored keys (dead ones included); until then
+    // removes rebuild nothing and the dead keys stay stored
+    for (double threshold : {0.0, 0.1, 0.5, 1.0}) {
+        AVLTree<int> tree;
+        std::vector<int> keys(1000);
+        for (int i = 0; i < 1000; i++) {
+            keys[i] = 2 * i;
+        }
+        tree.bulkLoad(keys);
+        tree.setTombstones(threshold);
+        std::set<int> ref(keys.begin(), keys.end());
+        size_t stored = ref.size();
+        size_t dead = 0;
+        int compactions = 0;
+        std::vector<int> order = keys;
+        std::shuffle(order.begin(), order.end(), rng);
+        for (int key : order) {
+            uint64_t rebuilds = tree.rebuildStats().calls;
+            tree.remove(key);
+            ref.erase(key);
+            dead++;
+            if ((double)dead > threshold * (double)stored) {
+                stored -= dead;
+                dead = 0;
+                compactions++;
+                CHECK(tree.rebuildStats().calls == rebuilds + 1);
+            } else {
+                CHECK(tree.rebuildStats().calls == rebuilds);
+            }
+            CHECK(tree.getSortedElements().size() == stored);
+            CHECK(tree.memoryStats().deadKeys == dead);
+            CHECK(tree.size() == ref.size());
+
+            // Re-inserting a dead key only clears its bit
+            if (dead > 0 && ref.size() % 7 == 0) {
+                tree.insert(key);
+                ref.insert(key);
+                dead--;
+                CHECK(tree.getSortedElements().size() == stored);
+                tree.remove(key);
+                ref.erase(key);
+                dead++;
+            }
+        }
+        CHECK(tree.size() == 0);
+        CHECK(threshold >= 1.0 ? compactions == 0 : compactions > 0);
+
+        // Inserting a new key purges the dead ones first
+        tree.bulkLoad(keys);
+        tree.remove(0);
+        tree.remove(2);
+        CHECK(tree.getSortedElements().size() == (threshold < 0.002 ? 998u : 1000u));
+        tree.insert(1);
+        CHECK(tree.getSortedElements().size() == 999);
+        CHECK(tree.memoryStats().deadKeys == 0);
+    }
+
+    return testExitCode("TombstoneTest");
+}
@@ -0,0 +1,148 @@
+// Traces written by several threads at once, read back with readTrace:
+// every record arrives, per thread in the order it was made, and the
+// operations of an AVLTree with a recorder match what it returned
+#include <cstdio>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../AVLTree.h"
+#include "../BenchEngines.h"
+#include "../TraceRecorder.h"
+#include "TestUtil.h"
+
+static const int kThreads = 4;
+// More than two buffers per thread, so full ones are handed off
+static const int kOpsPerThread = 3 * (int)TraceRecorder::kBufferRecords + 100;
+
+struct Expected {
+    TraceOp op;
+    int64_t key;
+    bool result;
+};
+
+int main(int, char** argv) {
+    std::string path = std::string(argv[0]) + ".trace";
+
+    // Threads replaying a random stream on a shared ConcurrentAVLTree
+    // engine; thread t only uses keys with key % kThreads == t, so the
+    // records tell which thread made them
+    {
+        std::vector<std::vector<Expected>> expected(kThreads);
+        std::vector<int> wrongSearches(kThreads, 0);
+        {
+            TraceRecorder recorder(path);
+            CHECK(recorder.isOpen());
+            ConcurrentAVLTreeEngine<int64_t> engine;
+            std::vector<std::thread> workers;
+            for (int t = 0; t < kThreads; t++) {
+                workers.emplace_back([&, t]() {
+                    std::mt19937 rng(100 + t);
+                    std::set<int64_t> mine;
+                    for (int i = 0; i < kOpsPerThread; i++) {
+                        int64_t key = (int64_t)(rng() % 2000) * kThreads + t - 4000;
+                        TraceOp op = (TraceOp)(1 + rng() % 3);
+                        uint64_t start = recorder.now();
+                        bool result;
+                        if (op == TraceOp::Insert) {
+                            result = mine.insert(key).second;
+                            engine.insert(key);
+                        } else if (op == TraceOp::Remove) {
+                            result = mine.erase(key) != 0;
+                            engine.erase(key);
+                        } else {
+                            result = engine.contains(key);
+                            wrongSearches[t] += result != (mine.count(key) != 0);
+                        }
+                        recorder.record(op, key, start, result);
+                        expected[t].push_back({op, key, result});
+                    }
+                });
+            }
+            for (auto& w : workers) {
+                w.join();
+            }
+            for (int t = 0; t < kThreads; t++) {
+                CHECK(wrongSearches[t] == 0);
+            }
+            recorder.stop();
+            CHECK(recorder.droppedRecords() == 0);
+        }
+
+        std::vector<TraceRecord> trace;
+        CHECK(readTrace(path, trace));
+        CHECK(trace.size() == (size_t)kThreads * kOpsPerThread);
+
+        // Recorder thread id -> test thread, fixed by the first record
+        std::vector<int> owner(kThreads, -1);
+        std::vector<size_t> next(kThreads, 0);
+        std::vector<uint64_t> lastTs(kThreads, 0);
+        for (const TraceRecord& r : trace) {
+            CHECK(r.thread < kThreads);
+            if (r.thread >= kThreads) {
+                break;
+            }
+            int t = (int)(((r.key % kThreads) + kThreads) % kThreads);
+            if (owner[r.thread] < 0) {
+                owner[r.thread] = t;
+            }
+            CHECK(owner[r.thread] == t);
+            const Expected& e = expected[t][next[t]++];
+            CHECK((TraceOp)r.op == e.op && r.key == e.key && (r.result != 0) == e.result);
+            CHECK(r.timestampNs >= lastTs[t]);
+            lastTs[t] = r.timestampNs;
+        }
+        for (int t = 0; t < kThreads; t++) {
+            CHECK(next[t] == (size_t)kOpsPerThread);
+        }
+        std::set<int> owners(owner.begin(), owner.end());
+        CHECK(owners.size() == (size_t)kThreads && *owners.begin() == 0);
+    }
+
+    // A tree with a recorder logs its own operations and their results
+    {
+        std::vector<Expected> expected;
+        {
+            TraceRecorder recorder(path);
+            AVLTree<int> tree;
+            tree.setRecorder(&recorder);
+            std::mt19937 rng(9);
+            for (int i = 0; i < 2000; i++) {
+                int key = (int)(rng() % 300) - 150;
+                switch (rng() % 3) {
+                case 0: {
+                    size_t before = tree.size();
+                    tree.insert(key);
+                    expected.push_back({TraceOp::Insert, key, tree.size() != before});
+                    break;
+                }
+                case 1: {
+                    size_t before = tree.size();
+                    tree.remove(key);
+                    expected.push_back({TraceOp::Remove, key, tree.size() != before});
+                    break;
+                }
+                default:
+                    expected.push_back({TraceOp::Search, key, tree.search(key)});
+                    break;
+                }
+            }
+            tree.setRecorder(nullptr);
+        }
+
+        std::vector<TraceRecord> trace;
+        CHECK(readTrace(path, trace));
+        CHECK(trace.size() == expected.size());
+        for (size_t i = 0; i < trace.size() && i < expected.size(); i++) {
+            const TraceRecord& r = trace[i];
+            CHECK((TraceOp)r.op == expected[i].op && r.key == expected[i].key
+                  && (r.result != 0) == expected[i].result && r.thread == 0);
+            CHECK(i == 0 || r.timestampNs >= trace[i - 1].timestampNs);
+        }
+    }
+
+    std::remove(path.c_str());
+    return testExitCode("TraceRecorderTest");
+}
@@ -0,0 +1,94 @@
+// Visit and hit counters across rebuilds, and the weighted tree built
+// from them, against counts kept on the side, also through appends
+// that reshape the tree in place
+#include <map>
+#include <random>
+#include <vector>
+
+#include "../AVLTree.h"
+#include "TestUtil.h"
+
+template <typename Fn>
+static void walk(const AVLNode<int>* node, Fn fn) {
+    if (node) {
+        walk(node->left, fn);
+        fn(node);
+        walk(node->right, fn);
+    }
+}
+
+static unsigned subtreeHits(const AVLNode<int>* node) {
+    return node ? node->hits.load() + subtreeHits(node->left) + subtreeHits(node->right) : 0;
+}
+
+int main() {
+    std::mt19937 rng(5);
+    AVLTree<int> tree;
+    for (int key = 0; key < 2000; key += 2) {
+        tree.insert(key);
+    }
+    tree.setVisitCounting(true);
+
+    // A hot key, some warm ones, and many misses (odd keys), which
+    // pass through nodes without ending on any key
+    std::map<int, unsigned> found;
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 3000; i++) {
+            int key = rng() % 4 != 0 ? 1998 : (int)(rng() % 2000);
+            if (tree.search(key)) {
+                found[key]++;
+            }
+        }
+        // Shifts every rank, so the tree changes shape under the keys
+        tree.insert(-2 - 2 * round);
+    }
+
+    walk(tree.getRoot(), [&](const AVLNode<int>* node) {
+        auto it = found.find(node->key);
+        CHECK(node->hits.load() == (it == found.end() ? 0u : it->second));
+        CHECK(node->visits.load() >= subtreeHits(node));
+    });
+
+    tree.buildWeightedFromVisits();
+    const AVLNode<int>* weightedRoot = tree.getWeightedRoot();
+    CHECK(weightedRoot && weightedRoot->key == 1998);
+    for (int key = -6; key < 2001; key++) {
+        CHECK(tree.searchWeighted(key) == tree.search(key));
+    }
+
+    tree.resetVisits();
+    walk(tree.getRoot(), [&](const AVLNode<int>* node) {
+        CHECK(node->hits.load() == 0 && node->visits.load() == 0);
+    });
+
+    // Ascending inserts with counting on still append in place: the
+    // same nodes built and rebuilds timed as without counting, and the
+    // root only moves when the arena has to grow. The hits follow
+    // their keys through the reshaped subtrees.
+    {
+        AVLTree<int> counted, plain;
+        counted.setVisitCounting(true);
+        std::map<int, unsigned> hits;
+        int rootMoves = 0;
+        for (int key = 0; key < 4000; key++) {
+            const AVLNode<int>* before = counted.getRoot();
+            counted.insert(key);
+            plain.insert(key);
+            rootMoves += before != counted.getRoot();
+            for (int probe : {(int)(rng() % (key + 1)), key - (int)(rng() % 4)}) {
+                if (counted.search(probe)) {
+                    hits[probe]++;
+                }
+            }
+        }
+        CHECK(counted.memoryStats().nodesAllocated == plain.memoryStats().nodesAllocated);
+        CHECK(counted.rebuildStats().calls == plain.rebuildStats().calls);
+        CHECK(rootMoves < 400);
+        walk(counted.getRoot(), [&](const AVLNode<int>* node) {
+            auto it = hits.find(node->key);
+            CHECK(node->hits.load() == (it == hits.end() ? 0u : it->second));
+            CHECK(node->visits.load() >= subtreeHits(node));
+        });
+    }
+    return testExitCode("VisitCountTest");
+}